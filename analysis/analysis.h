@@ -0,0 +1,30 @@
+/*
+ * Helpers shared by differential.c and linear.c.
+ *
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+
+#include "des_64.h"  // left_block_order, right_block_order
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15LL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9LL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebLL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Gives the block_bits index of bit i (0 to 63) of L||R after num_rounds
+ * rounds.  des_round never switches the halves, so they trade places every
+ * round.
+ */
+static int state_position(int i, int num_rounds) {
+    int half = (i >= 32) ^ (num_rounds % 2);
+    return (half ? right_block_order : left_block_order)[i % 32];
+}
+
+#endif
@@ -0,0 +1,337 @@
+/*
+ * Collects differential statistics for reduced round DES.
+ *
+ * Pairs of plaintexts with a chosen input XOR are encrypted under random
+ * keys for a chosen number of rounds, and the output XORs are counted.  This
+ * is what estimating the probability of a differential or characteristic
+ * (Biham and Shamir) takes, just many more pairs than des.py could manage.
+ *
+ * Everything is done 64 pairs at a time with des_round from des_64.h.
+ * Keys and plaintexts are random, so they are generated directly as random
+ * slices instead of being zipped.  Differences are always given as L||R
+ * after the initial permutation, which is how characteristics are written,
+ * so no permutation is ever done: the input XOR only says which slices to
+ * flip, and checking a round of a characteristic is comparing slices.
+ * Counters stay in zipped form too: a batch only adds the popcount of a 64
+ * lane mask.  Pairs are only unzipped for the optional histogram.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "des_64.h"  // des_round, zip_64_bit
+#include "parse.h"  // parse_hex
+#include "analysis.h"  // splitmix64, state_position
+
+#define MAX_HISTOGRAM_BITS 24
+#define ALL_ONES 0xffffffffffffffffLL
+
+struct experiment {
+    int num_rounds;
+    uint64_t input_xor;
+    // Characteristic: the expected XOR after each round, as slices in
+    // block_bits positions.  Only the first num_characteristic rounds.
+    int num_characteristic;
+    uint64_t characteristic[16];
+    uint64_t characteristic_slices[16][64];
+
+    // Optional expected output XOR
+    int has_output_xor;
+    uint64_t output_xor;
+    uint64_t output_xor_slices[64];
+
+    // Optional histogram of the output XOR bits in histogram_mask
+    uint64_t histogram_mask;
+    int histogram_bits;
+};
+
+struct thread_state {
+    const struct experiment* experiment;
+    uint64_t seed;
+    uint64_t num_batches;
+
+    uint64_t characteristic_counts[16];
+    uint64_t output_xor_count;
+    uint64_t* histogram;
+};
+
+
+/***** Slices *****/
+
+// Slices that are all ones where value (as L||R after num_rounds) has a 1
+static void state_slices(uint64_t value, int num_rounds, uint64_t slices[64]) {
+    for (int i=0; i<64; i++) {
+        slices[state_position(i, num_rounds)] = (value >> (63-i)) & 1 ? ALL_ONES : 0;
+    }
+}
+
+// Lanes where a XOR b is equal to expected, everywhere
+static uint64_t match(const uint64_t a[64], const uint64_t b[64], const uint64_t expected[64]) {
+    uint64_t mismatch = 0;
+    for (int i=0; i<64; i++) {
+        mismatch |= a[i] ^ b[i] ^ expected[i];
+    }
+    return ~mismatch;
+}
+
+static void add_to_histogram(const struct experiment* experiment, const uint64_t a[64], const uint64_t b[64], uint64_t* histogram) {
+    uint64_t xor_slices[64];
+    uint64_t xors[64];
+
+    for (int i=0; i<64; i++) {
+        int position = state_position(i, experiment->num_rounds);
+        xor_slices[i] = a[position] ^ b[position];
+    }
+    zip_64_bit(xor_slices, xors);
+
+    for (int lane=0; lane<64; lane++) {
+        uint64_t index = 0;
+        int bit = 0;
+        for (uint64_t mask = experiment->histogram_mask; mask; mask &= mask - 1) {
+            if (xors[lane] & mask & -mask) {
+                index |= 1ULL << bit;
+            }
+            bit++;
+        }
+        histogram[index]++;
+    }
+}
+
+
+/***** Experiment *****/
+
+static void* experiment_thread(void* arg) {
+    struct thread_state* state = arg;
+    const struct experiment* experiment = state->experiment;
+    uint64_t input_slices[64];
+    uint64_t key_bits[64];
+    uint64_t a[64], b[64];
+    uint64_t random = state->seed;
+
+    state_slices(experiment->input_xor, 0, input_slices);
+    int need_all_rounds = experiment->has_output_xor || experiment->histogram_bits;
+
+    for (uint64_t batch=0; batch<state->num_batches; batch++) {
+
+        // 64 random keys and plaintexts, already zipped
+        for (int i=0; i<64; i++) {
+            key_bits[i] = splitmix64(&random);
+            a[i] = splitmix64(&random);
+            b[i] = a[i] ^ input_slices[i];
+        }
+
+        uint64_t following = ALL_ONES;
+        for (int round=0; round<experiment->num_rounds; round++) {
+            des_round(a, key_bits, round);
+            des_round(b, key_bits, round);
+
+            if (round < experiment->num_characteristic) {
+                following &= match(a, b, experiment->characteristic_slices[round]);
+                state->characteristic_counts[round] += __builtin_popcountll(following);
+                if (!following && !need_all_rounds) {
+                    break;
+                }
+            }
+        }
+
+        if (experiment->has_output_xor) {
+            state->output_xor_count += __builtin_popcountll(match(a, b, experiment->output_xor_slices));
+        }
+        if (experiment->histogram_bits) {
+            add_to_histogram(experiment, a, b, state->histogram);
+        }
+    }
+    return NULL;
+}
+
+// A count out of total as a power of 2
+static void print_probability(uint64_t count, uint64_t total) {
+    if (count) {
+        printf("2^%.2f", log2((double) count / total));
+    } else {
+        printf("0");
+    }
+}
+
+
+/***** Main *****/
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: differential [options] <input_xor>\n"
+        "\n"
+        "Encrypts pairs of random plaintexts with XOR input_xor under random keys,\n"
+        "for a number of rounds, and counts their output XORs.  XORs are 16 hex\n"
+        "digits, L||R after the initial permutation.\n"
+        "\n"
+        "Options:\n"
+        "  -r ROUNDS   Rounds to encrypt, 1 to 16.  Default 16.\n"
+        "  -n BITS     Encrypt 2^BITS pairs (rounded up to 64 per thread).\n"
+        "              Default 24.\n"
+        "  -c XOR      Expected XOR after the next round of a characteristic.  Give\n"
+        "              once per round, starting with round 1.  Pairs that have\n"
+        "              followed the characteristic so far are counted every round.\n"
+        "  -o XOR      Count pairs with this output XOR.\n"
+        "  -m MASK     Histogram of the output XOR bits in MASK (at most %d bits).\n"
+        "  -T TOP      Print the TOP most common masked output XORs.  Default 20.\n"
+        "  -s SEED     Random seed.  Default is the time.\n"
+        "  -t THREADS  Number of threads.  Default is the number of cores.\n",
+        MAX_HISTOGRAM_BITS);
+    exit(2);
+}
+
+static int compare_counts(const void* a, const void* b) {
+    uint64_t count_a = *(const uint64_t*) a;
+    uint64_t count_b = *(const uint64_t*) b;
+    return (count_a < count_b) - (count_a > count_b);
+}
+
+int main(int argc, char** argv) {
+    static struct experiment experiment;
+    experiment.num_rounds = 16;
+    int log2_pairs = 24;
+    int top = 20;
+    uint64_t seed = time(NULL);
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:c:o:m:T:s:t:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                experiment.num_rounds = atoi(optarg);
+                break;
+            case 'n':
+                log2_pairs = atoi(optarg);
+                break;
+            case 'c':
+                if (experiment.num_characteristic == 16) {
+                    usage();
+                }
+                experiment.characteristic[experiment.num_characteristic++] = parse_hex(optarg, 16);
+                break;
+            case 'o':
+                experiment.has_output_xor = 1;
+                experiment.output_xor = parse_hex(optarg, 16);
+                break;
+            case 'm':
+                experiment.histogram_mask = parse_hex(optarg, 16);
+                experiment.histogram_bits = __builtin_popcountll(experiment.histogram_mask);
+                break;
+            case 'T':
+                top = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc-1 || experiment.num_rounds < 1 || experiment.num_rounds > 16 ||
+            log2_pairs < 0 || log2_pairs > 62 || num_threads < 1 ||
+            experiment.num_characteristic > experiment.num_rounds ||
+            experiment.histogram_bits > MAX_HISTOGRAM_BITS) {
+        usage();
+    }
+    experiment.input_xor = parse_hex(argv[optind], 16);
+    for (int round=0; round<experiment.num_characteristic; round++) {
+        state_slices(experiment.characteristic[round], round+1, experiment.characteristic_slices[round]);
+    }
+    if (experiment.has_output_xor) {
+        state_slices(experiment.output_xor, experiment.num_rounds, experiment.output_xor_slices);
+    }
+
+    // Split the batches between threads
+    uint64_t batches_per_thread = ((1ULL << log2_pairs) + 64*num_threads - 1) / (64*num_threads);
+    uint64_t histogram_size = 1ULL << experiment.histogram_bits;
+    struct thread_state* states = calloc(num_threads, sizeof(struct thread_state));
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<num_threads; i++) {
+        states[i].experiment = &experiment;
+        states[i].seed = seed + i * 0x632be59bd9b4e019ULL;
+        states[i].num_batches = batches_per_thread;
+        if (experiment.histogram_bits) {
+            states[i].histogram = calloc(histogram_size, sizeof(uint64_t));
+        }
+        pthread_create(&threads[i], NULL, experiment_thread, &states[i]);
+    }
+    for (int i=0; i<num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Add up the threads
+    uint64_t num_pairs = batches_per_thread * 64 * num_threads;
+    uint64_t characteristic_counts[16] = {0};
+    uint64_t output_xor_count = 0;
+    for (int i=0; i<num_threads; i++) {
+        for (int round=0; round<experiment.num_characteristic; round++) {
+            characteristic_counts[round] += states[i].characteristic_counts[round];
+        }
+        output_xor_count += states[i].output_xor_count;
+        for (uint64_t j=0; j<histogram_size && i && experiment.histogram_bits; j++) {
+            states[0].histogram[j] += states[i].histogram[j];
+        }
+    }
+
+    printf("%lu pairs, %d rounds, input XOR %016lx\n", num_pairs, experiment.num_rounds, experiment.input_xor);
+    if (experiment.num_characteristic) {
+        printf("\nRound  Expected XOR      Pairs following  Probability\n");
+        for (int round=0; round<experiment.num_characteristic; round++) {
+            printf("%5d  %016lx  %15lu  ", round+1, experiment.characteristic[round], characteristic_counts[round]);
+            print_probability(characteristic_counts[round], num_pairs);
+            printf("\n");
+        }
+    }
+    if (experiment.has_output_xor) {
+        printf("\nOutput XOR %016lx: %lu pairs, ", experiment.output_xor, output_xor_count);
+        print_probability(output_xor_count, num_pairs);
+        printf("\n");
+    }
+    if (experiment.histogram_bits) {
+
+        // Sort (count, index) pairs by count
+        uint64_t (*entries)[2] = malloc(histogram_size * sizeof(*entries));
+        for (uint64_t index=0; index<histogram_size; index++) {
+            entries[index][0] = states[0].histogram[index];
+            entries[index][1] = index;
+        }
+        qsort(entries, histogram_size, sizeof(*entries), compare_counts);
+
+        printf("\nOutput XOR under %016lx  Pairs            Probability\n", experiment.histogram_mask);
+        for (uint64_t i=0; i<histogram_size && i<(uint64_t) top && entries[i][0]; i++) {
+
+            // Spread the index back out over the mask
+            uint64_t xor = 0;
+            int bit = 0;
+            for (uint64_t mask = experiment.histogram_mask; mask; mask &= mask - 1) {
+                if (entries[i][1] >> bit++ & 1) {
+                    xor |= mask & -mask;
+                }
+            }
+            printf("%16s%016lx  %15lu  ", "", xor, entries[i][0]);
+            print_probability(entries[i][0], num_pairs);
+            printf("\n");
+        }
+        free(entries);
+    }
+
+    fprintf(stderr, "%.1f seconds, %.0f pairs/second\n", seconds, seconds > 0 ? num_pairs / seconds : 0);
+    return 0;
+}
@@ -0,0 +1,545 @@
+/*
+ * Counts linear approximations of reduced round DES.
+ *
+ * A linear approximation (Matsui) says the parity of some plaintext bits,
+ * ciphertext bits and key bits is more often 0 than 1, or the other way
+ * around.  Measuring the bias takes a lot of known pairs, and finding a key
+ * with one (Matsui's algorithm 2) takes a count for every guess of a
+ * partial subkey.  Both are counted here, 64 pairs at a time with des_round
+ * from des_64.h, for many approximations at once.
+ *
+ * In zipped format the parity of a mask is just the XOR of a few slices, so
+ * no pair is ever unzipped, and counting 64 pairs is one popcount.  Each
+ * thread keeps its own counts, which are only added up at the end.
+ *
+ * Pairs are either generated, with random plaintexts under random keys or
+ * one given key, or read from a file of known pairs.  Like differential.c,
+ * masks are given as L||R after the initial permutation and after the last
+ * round, so no permutation is done for generated pairs.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "des_64.h"  // des_round, zip_64_bit, s0-s7, key_bit_orders
+#include "parse.h"  // parse_hex
+#include "analysis.h"  // splitmix64, state_position
+
+#define MAX_APPROXIMATIONS 64
+#define NUM_GUESSES 64
+#define ALL_ONES 0xffffffffffffffffLL
+
+// Pairs are read from files in chunks of this many batches
+#define READ_BATCHES 64
+
+struct approximation {
+    const char* string;
+    uint64_t plaintext_mask;
+    uint64_t ciphertext_mask;
+    uint64_t key_mask;  // In key bit positions, parity bits never set
+
+    // Slices to XOR for the parity
+    int num_plaintext_slices, num_ciphertext_slices, num_key_slices;
+    unsigned char plaintext_slices[64];
+    unsigned char ciphertext_slices[64];
+    unsigned char key_slices[56];
+
+    // With a guessed sbox: which of its 4 outputs are in the mask
+    int num_guess_outputs;
+    unsigned char guess_outputs[4];
+};
+
+struct experiment {
+    int num_rounds;
+    int num_approximations;
+    struct approximation approximations[MAX_APPROXIMATIONS];
+
+    // Fixed key, or random keys for every pair
+    int has_key;
+    uint64_t key;
+
+    // Partial subkey guessing for this sbox of the last round, or -1
+    int guess_sbox;
+
+    // Known pairs instead of generated ones
+    FILE* input;
+    pthread_mutex_t input_lock;
+};
+
+struct thread_state {
+    struct experiment* experiment;
+    uint64_t seed;
+    uint64_t num_batches;  // Generated pairs only
+
+    uint64_t num_pairs;
+    uint64_t* counts;  // [approximation] or [approximation][guess]
+};
+
+
+/***** Slices *****/
+
+static uint64_t parity(const uint64_t* slices, const unsigned char* indexes, int n) {
+    uint64_t result = 0;
+    for (int i=0; i<n; i++) {
+        result ^= slices[indexes[i]];
+    }
+    return result;
+}
+
+// Outputs of sbox snum for all lanes, given its 6 inputs
+static void sbox(int snum, const uint64_t in[6], uint64_t out[4]) {
+    switch (snum) {
+        #define CASE(snum) case snum: \
+            s ## snum(in[0], in[1], in[2], in[3], in[4], in[5], &out[0], &out[1], &out[2], &out[3]); \
+            break;
+        CASE(0) CASE(1) CASE(2) CASE(3) CASE(4) CASE(5) CASE(6) CASE(7)
+        #undef CASE
+    }
+}
+
+// Bit i of the 48 bit subkey for round (0 to 15), as a 64 bit key mask
+static uint64_t subkey_bit(int round, int i) {
+    return 1ULL << (63 - key_bit_orders[round][i]);
+}
+
+// The 6 subkey bits that go into sbox snum in a round of key
+static int partial_subkey(uint64_t key, int round, int snum) {
+    int subkey = 0;
+    for (int i=0; i<6; i++) {
+        subkey = subkey << 1 | ((key & subkey_bit(round, snum*6 + i)) != 0);
+    }
+    return subkey;
+}
+
+
+/***** Experiment *****/
+
+/*
+ * Adds a batch of 64 pairs to the counts.  plaintext is the block before
+ * the first round and ciphertext after the last, with L||R bit i at
+ * state_position(i, 0) and state_position(i, ciphertext_rounds).
+ */
+static void count_batch(const struct experiment* experiment, struct thread_state* state,
+        const uint64_t plaintext[64], const uint64_t ciphertext[64],
+        const uint64_t key_bits[64], int ciphertext_rounds, uint64_t lanes) {
+    uint64_t sbox_out[NUM_GUESSES][4];
+
+    if (experiment->guess_sbox >= 0) {
+
+        // Undo the last round's sbox for every guess: its inputs are the
+        // expanded bits of L after the last round.
+        int snum = experiment->guess_sbox;
+        uint64_t expanded[6];
+        for (int i=0; i<6; i++) {
+            expanded[i] = ciphertext[state_position((4*snum + i + 31) % 32, ciphertext_rounds)];
+        }
+        for (int guess=0; guess<NUM_GUESSES; guess++) {
+            uint64_t in[6];
+            for (int i=0; i<6; i++) {
+                in[i] = expanded[i] ^ (guess >> (5-i) & 1 ? ALL_ONES : 0);
+            }
+            sbox(snum, in, sbox_out[guess]);
+        }
+    }
+
+    for (int a=0; a<experiment->num_approximations; a++) {
+        const struct approximation* approximation = &experiment->approximations[a];
+        uint64_t base = parity(plaintext, approximation->plaintext_slices, approximation->num_plaintext_slices) ^
+                        parity(ciphertext, approximation->ciphertext_slices, approximation->num_ciphertext_slices) ^
+                        parity(key_bits, approximation->key_slices, approximation->num_key_slices);
+
+        // Count lanes where the parity is 0
+        if (experiment->guess_sbox < 0) {
+            state->counts[a] += __builtin_popcountll(~base & lanes);
+        } else {
+            uint64_t* counts = &state->counts[a * NUM_GUESSES];
+            for (int guess=0; guess<NUM_GUESSES; guess++) {
+                uint64_t p = base;
+                for (int i=0; i<approximation->num_guess_outputs; i++) {
+                    p ^= sbox_out[guess][approximation->guess_outputs[i]];
+                }
+                counts[guess] += __builtin_popcountll(~p & lanes);
+            }
+        }
+    }
+}
+
+static void key_slices(uint64_t key, uint64_t key_bits[64]) {
+    for (int i=0; i<64; i++) {
+        key_bits[i] = (key >> (63-i)) & 1 ? ALL_ONES : 0;
+    }
+}
+
+// Random plaintexts, encrypted here
+static void* generate_thread(void* arg) {
+    struct thread_state* state = arg;
+    const struct experiment* experiment = state->experiment;
+    uint64_t random = state->seed;
+    uint64_t key_bits[64];
+    uint64_t plaintext[64];
+    uint64_t block[64];
+
+    if (experiment->has_key) {
+        key_slices(experiment->key, key_bits);
+    }
+
+    for (uint64_t batch=0; batch<state->num_batches; batch++) {
+        for (int i=0; i<64; i++) {
+            if (!experiment->has_key) {
+                key_bits[i] = splitmix64(&random);
+            }
+            plaintext[i] = block[i] = splitmix64(&random);
+        }
+        for (int round=0; round<experiment->num_rounds; round++) {
+            des_round(block, key_bits, round);
+        }
+        count_batch(experiment, state, plaintext, block, key_bits, experiment->num_rounds, ALL_ONES);
+    }
+    state->num_pairs = state->num_batches * 64;
+    return NULL;
+}
+
+static uint64_t read_uint64(const unsigned char* bytes) {
+    uint64_t value = 0;
+    for (int i=0; i<8; i++) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+/*
+ * Known pairs from experiment->input: 16 byte records, the plaintext then
+ * the ciphertext, big endian.  Threads take READ_BATCHES batches at a time.
+ */
+static void* read_thread(void* arg) {
+    struct thread_state* state = arg;
+    struct experiment* experiment = state->experiment;
+    static const uint64_t no_key[64];
+    unsigned char (*records)[16] = malloc(READ_BATCHES * 64 * 16);
+    uint64_t blocks[64];
+    uint64_t plaintext[64];
+    uint64_t ciphertext[64];
+
+    while (1) {
+        pthread_mutex_lock(&experiment->input_lock);
+        size_t num_records = fread(records, 16, READ_BATCHES * 64, experiment->input);
+        pthread_mutex_unlock(&experiment->input_lock);
+        if (num_records == 0) {
+            break;
+        }
+
+        for (size_t start=0; start<num_records; start+=64) {
+            size_t n = num_records - start < 64 ? num_records - start : 64;
+            memset(blocks, 0, sizeof(blocks));
+            for (size_t i=0; i<n; i++) {
+                blocks[i] = read_uint64(records[start+i]);
+            }
+            zip_64_bit(blocks, plaintext);
+            for (size_t i=0; i<n; i++) {
+                blocks[i] = read_uint64(records[start+i] + 8);
+            }
+            zip_64_bit(blocks, ciphertext);
+
+            // Lane l is bit 63-l of a slice
+            uint64_t lanes = n == 64 ? ALL_ONES : ~(ALL_ONES >> n);
+            count_batch(experiment, state, plaintext, ciphertext, no_key, 1, lanes);
+            state->num_pairs += n;
+        }
+    }
+    free(records);
+    return NULL;
+}
+
+
+/***** Output *****/
+
+// The bias of count out of total, and its size as a power of 2
+static void print_bias(uint64_t count, uint64_t total) {
+    double bias = (double) count / total - 0.5;
+    printf("%+.6f  ", bias);
+    if (bias) {
+        printf("2^%.2f", log2(fabs(bias)));
+    } else {
+        printf("0");
+    }
+}
+
+struct guess_count {
+    int guess;
+    uint64_t count;
+    double bias;
+};
+
+// Largest bias first
+static int compare_guesses(const void* a, const void* b) {
+    double bias_a = fabs(((const struct guess_count*) a)->bias);
+    double bias_b = fabs(((const struct guess_count*) b)->bias);
+    return (bias_a < bias_b) - (bias_a > bias_b);
+}
+
+
+/***** Main *****/
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: linear [options] <approximation>...\n"
+        "\n"
+        "Counts pairs where the parity of each approximation is 0.  An\n"
+        "approximation is PMASK,CMASK[,ROUND:SUBKEYMASK]...  PMASK and CMASK are\n"
+        "16 hex digits, L||R after the initial permutation and after the last\n"
+        "round.  SUBKEYMASK is 12 hex digits of the 48 bit subkey for ROUND, 1 to\n"
+        "16; give as many as the approximation has.\n"
+        "\n"
+        "Options:\n"
+        "  -r ROUNDS   Rounds to encrypt, 1 to 16.  Default 16.\n"
+        "  -n BITS     Generate 2^BITS pairs (rounded up to 64 per thread).\n"
+        "              Default 24.\n"
+        "  -k KEY      Encrypt every pair with KEY instead of random keys.\n"
+        "  -f FILE     Read known pairs from FILE (- for stdin) instead:\n"
+        "              16 byte records, plaintext then ciphertext, big endian.\n"
+        "              Key masks are left out, since the key is unknown.\n"
+        "  -g SBOX     Guess the 6 subkey bits of SBOX (1 to 8) in the last\n"
+        "              round and count each guess.  CMASK is then after the\n"
+        "              second to last round, and its bits in L can only be\n"
+        "              outputs of SBOX.  Needs -k or -f.\n"
+        "  -T TOP      With -g, print the TOP guesses with the largest bias.\n"
+        "              Default 8.\n"
+        "  -s SEED     Random seed.  Default is the time.\n"
+        "  -t THREADS  Number of threads.  Default is the number of cores.\n");
+    exit(2);
+}
+
+static void parse_approximation(struct experiment* experiment, struct approximation* approximation, char* string) {
+    approximation->string = strdup(string);
+    char* field = strtok(string, ",");
+    char* ciphertext_field = strtok(NULL, ",");
+    if (!field || !ciphertext_field) {
+        usage();
+    }
+    approximation->plaintext_mask = parse_hex(field, 16);
+    approximation->ciphertext_mask = parse_hex(ciphertext_field, 16);
+
+    // Subkey bits become key bits, which cancel if a key bit is used twice
+    while ((field = strtok(NULL, ","))) {
+        char* colon = strchr(field, ':');
+        if (!colon) {
+            usage();
+        }
+        *colon = '\0';
+        int round = atoi(field);
+        uint64_t subkey_mask = parse_hex(colon+1, 12);
+        if (round < 1 || round > 16) {
+            usage();
+        }
+        for (int i=0; i<48; i++) {
+            if (subkey_mask >> (47-i) & 1) {
+                approximation->key_mask ^= subkey_bit(round-1, i);
+            }
+        }
+    }
+
+    // Slices.  For pairs read from a file the ciphertext has gone through
+    // the final swap and permutation, which puts L||R where des_round leaves
+    // it after an odd number of rounds, so it's at state_position(i, 1).
+    int ciphertext_rounds = experiment->input ? 1 : experiment->num_rounds;
+    for (int i=0; i<64; i++) {
+        if (approximation->plaintext_mask >> (63-i) & 1) {
+            approximation->plaintext_slices[approximation->num_plaintext_slices++] = state_position(i, 0);
+        }
+    }
+    if (!experiment->input) {
+        for (int i=0; i<64; i++) {
+            if (approximation->key_mask >> (63-i) & 1) {
+                approximation->key_slices[approximation->num_key_slices++] = i;
+            }
+        }
+    }
+    for (int i=0; i<64; i++) {
+        if (!(approximation->ciphertext_mask >> (63-i) & 1)) {
+            continue;
+        }
+        if (experiment->guess_sbox < 0) {
+            approximation->ciphertext_slices[approximation->num_ciphertext_slices++] = state_position(i, ciphertext_rounds);
+        } else if (i >= 32) {
+            // R before the last round is L after it
+            approximation->ciphertext_slices[approximation->num_ciphertext_slices++] = state_position(i-32, ciphertext_rounds);
+        } else {
+            // L before the last round is R after it XOR an sbox output
+            int output;
+            for (output=0; output<4; output++) {
+                if (feistel_output_order[experiment->guess_sbox*4 + output] == i) {
+                    break;
+                }
+            }
+            if (output == 4) {
+                fprintf(stderr, "Error: Bit %d of CMASK in %s is not an output of S%d\n",
+                        i, approximation->string, experiment->guess_sbox+1);
+                exit(2);
+            }
+            approximation->ciphertext_slices[approximation->num_ciphertext_slices++] = state_position(i+32, ciphertext_rounds);
+            approximation->guess_outputs[approximation->num_guess_outputs++] = output;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    static struct experiment experiment;
+    experiment.num_rounds = 16;
+    experiment.guess_sbox = -1;
+    int log2_pairs = 24;
+    int top = 8;
+    const char* input_filename = NULL;
+    uint64_t seed = time(NULL);
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:k:f:g:T:s:t:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                experiment.num_rounds = atoi(optarg);
+                break;
+            case 'n':
+                log2_pairs = atoi(optarg);
+                break;
+            case 'k':
+                experiment.has_key = 1;
+                experiment.key = parse_hex(optarg, 16);
+                break;
+            case 'f':
+                input_filename = optarg;
+                break;
+            case 'g':
+                experiment.guess_sbox = atoi(optarg) - 1;
+                if (experiment.guess_sbox < 0 || experiment.guess_sbox > 7) {
+                    usage();
+                }
+                break;
+            case 'T':
+                top = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    int num_approximations = argc - optind;
+    if (num_approximations < 1 || num_approximations > MAX_APPROXIMATIONS ||
+            experiment.num_rounds < 1 || experiment.num_rounds > 16 ||
+            log2_pairs < 0 || log2_pairs > 62 || num_threads < 1 ||
+            (input_filename && experiment.has_key) ||
+            (experiment.guess_sbox >= 0 && !input_filename && !experiment.has_key)) {
+        usage();
+    }
+
+    if (input_filename) {
+        experiment.input = strcmp(input_filename, "-") ? fopen(input_filename, "rb") : stdin;
+        if (!experiment.input) {
+            perror(input_filename);
+            return 1;
+        }
+        pthread_mutex_init(&experiment.input_lock, NULL);
+    }
+    for (int i=0; i<num_approximations; i++) {
+        parse_approximation(&experiment, &experiment.approximations[i], argv[optind+i]);
+    }
+    experiment.num_approximations = num_approximations;
+
+    // Split the work between threads
+    int guesses = experiment.guess_sbox < 0 ? 1 : NUM_GUESSES;
+    uint64_t batches_per_thread = ((1ULL << log2_pairs) + 64*num_threads - 1) / (64*num_threads);
+    struct thread_state* states = calloc(num_threads, sizeof(struct thread_state));
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<num_threads; i++) {
+        states[i].experiment = &experiment;
+        states[i].seed = seed + i * 0x632be59bd9b4e019ULL;
+        states[i].num_batches = batches_per_thread;
+        states[i].counts = calloc(num_approximations * guesses, sizeof(uint64_t));
+        pthread_create(&threads[i], NULL, input_filename ? read_thread : generate_thread, &states[i]);
+    }
+    for (int i=0; i<num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Add up the threads
+    uint64_t num_pairs = 0;
+    for (int i=0; i<num_threads; i++) {
+        num_pairs += states[i].num_pairs;
+        for (int j=0; j<num_approximations * guesses && i; j++) {
+            states[0].counts[j] += states[i].counts[j];
+        }
+    }
+    const uint64_t* counts = states[0].counts;
+    if (!num_pairs) {
+        fprintf(stderr, "Error: No pairs\n");
+        return 1;
+    }
+
+    printf("%lu pairs, %d rounds, ", num_pairs, experiment.num_rounds);
+    if (input_filename) {
+        printf("known pairs from %s\n", input_filename);
+    } else if (experiment.has_key) {
+        printf("key %016lx\n", experiment.key);
+    } else {
+        printf("random keys\n");
+    }
+
+    if (experiment.guess_sbox < 0) {
+        printf("\nPlaintext mask    Ciphertext mask   Key mask          Parity 0 count  Bias\n");
+        for (int a=0; a<num_approximations; a++) {
+            const struct approximation* approximation = &experiment.approximations[a];
+            printf("%016lx  %016lx  %016lx  %14lu  ", approximation->plaintext_mask,
+                   approximation->ciphertext_mask, input_filename ? 0 : approximation->key_mask,
+                   counts[a]);
+            print_bias(counts[a], num_pairs);
+            printf("\n");
+        }
+    } else {
+        int snum = experiment.guess_sbox;
+        int right_guess = experiment.has_key ? partial_subkey(experiment.key, experiment.num_rounds-1, snum) : -1;
+        for (int a=0; a<num_approximations; a++) {
+            struct guess_count sorted[NUM_GUESSES];
+            for (int guess=0; guess<NUM_GUESSES; guess++) {
+                sorted[guess].guess = guess;
+                sorted[guess].count = counts[a*NUM_GUESSES + guess];
+                sorted[guess].bias = (double) sorted[guess].count / num_pairs - 0.5;
+            }
+            qsort(sorted, NUM_GUESSES, sizeof(sorted[0]), compare_guesses);
+
+            printf("\n%s: S%d of round %d\n", experiment.approximations[a].string, snum+1, experiment.num_rounds);
+            printf("Rank  Subkey  Parity 0 count  Bias\n");
+            for (int i=0; i<NUM_GUESSES && i<top; i++) {
+                printf("%4d    %02x%s  %14lu  ", i+1, sorted[i].guess,
+                       sorted[i].guess == right_guess ? "*" : " ", sorted[i].count);
+                print_bias(sorted[i].count, num_pairs);
+                printf("\n");
+            }
+            for (int i=top; i<NUM_GUESSES; i++) {
+                if (sorted[i].guess == right_guess) {
+                    printf("Right subkey %02x is rank %d\n", right_guess, i+1);
+                }
+            }
+        }
+    }
+
+    fprintf(stderr, "%.1f seconds, %.0f pairs/second\n", seconds, seconds > 0 ? num_pairs / seconds : 0);
+    return 0;
+}
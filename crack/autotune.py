@@ -0,0 +1,162 @@
+"""
+Finds the fastest way to run check_keys on this host and saves it.
+
+Every combination of the compile time settings (BS_WIDTH, INTERLEAVE,
+PREFILTER_SBOXES and ARCH_FLAGS in the Makefile) is built and timed on one
+chunk with the current input.h.  Then the fastest build is run as several
+processes at once to find how many threads give the most keys per second in
+total.  The results go in tune-<hostname>.mk, which the Makefile includes and
+native_worker and worker.py read their default thread count from.
+
+"""
+
+import os
+import re
+import socket
+import sys
+import time
+from multiprocessing import cpu_count
+from optparse import OptionParser
+from subprocess import Popen, PIPE, CalledProcessError
+
+BS_WIDTHS = [64, 128, 256, 512]
+INTERLEAVES = [1, 2, 4]
+PREFILTER_SBOXES = [2, 3, 4]
+ARCH_FLAGS = ["", "-march=native"]
+
+def tune_file_name():
+    return "tune-%s.mk" % socket.gethostname()
+
+def read_tune_file(filename=None):
+    """Returns the settings in a tune file as a dict, empty if there isn't one."""
+    settings = {}
+    try:
+        f = open(filename or tune_file_name())
+    except IOError:
+        return settings
+    for line in f:
+        match = re.match(r"^\s*(\w+)\s*\??=\s*(.*?)\s*$", line)
+        if match:
+            settings[match.group(1)] = match.group(2)
+    f.close()
+    return settings
+
+def read_num_chunk_bits():
+    for line in open("input.h"):
+        match = re.match(r"^#define NUM_CHUNK_BITS (\d+)", line)
+        if match:
+            return int(match.group(1))
+    raise ValueError("NUM_CHUNK_BITS not found in input.h")
+
+def build(settings):
+    """Builds check_keys with the given settings, overriding the tune file."""
+    args = ["make", "-s", "-B", "check_keys"]
+    args += ["%s=%s" % item for item in sorted(settings.items())]
+    process = Popen(args)
+    if process.wait():
+        raise CalledProcessError(process.returncode, args)
+
+def time_processes(num_processes, num_chunk_bits):
+    """Runs check_keys on a chunk in num_processes processes at once."""
+    prefix = "0" * (56 - num_chunk_bits)
+    start = time.time()
+    processes = [Popen(["./check_keys", prefix], stdout=PIPE) for i in range(num_processes)]
+    for process in processes:
+        process.communicate()
+    return time.time() - start
+
+def keys_per_second(num_processes, num_chunk_bits, repeat):
+    seconds = min(time_processes(num_processes, num_chunk_bits) for i in range(repeat))
+    return num_processes * 2**num_chunk_bits / seconds
+
+def describe(settings):
+    return " ".join("%s=%s" % (name, settings[name] or '""') for name in sorted(settings))
+
+def write_tune_file(filename, settings, threads, single_rate, total_rate, num_chunk_bits):
+    f = open(filename, "w")
+    f.write("# Written by autotune.py on %s for %s, with NUM_CHUNK_BITS=%d.\n" %
+            (time.strftime("%Y-%m-%d %H:%M"), socket.gethostname(), num_chunk_bits))
+    f.write("# %.0f keys/second with 1 thread, %.0f with %d.\n" %
+            (single_rate, total_rate, threads))
+    for name in sorted(settings):
+        f.write("%s = %s\n" % (name, settings[name]))
+    f.write("THREADS = %d\n" % threads)
+    f.close()
+
+if __name__ == "__main__":
+
+    op = OptionParser(
+        usage="%prog [options]",
+        description="Benchmarks every check_keys build setting and thread "
+        "count on this host and writes the fastest to tune-<hostname>.mk.  "
+        "Uses the current input.h; each run searches one chunk, so a "
+        "NUM_CHUNK_BITS of 24 to 28 keeps tuning to a few minutes.")
+    op.add_option("-r", "--repeat", type="int", dest="repeat", default=2,
+        help="Times to run each benchmark.  The fastest run counts.  Default 2.")
+    op.add_option("-t", "--max-threads", type="int", dest="max_threads",
+        default=cpu_count(), help="Most threads to try.  Default is the "
+        "number of cores.")
+    op.add_option("-o", "--output", type="string", dest="output", default=None,
+        help="Write the results here instead of tune-<hostname>.mk.")
+    op.add_option("-n", "--dry-run", dest="dry_run", action="store_true",
+        default=False, help="Only print the results.")
+    (options, args) = op.parse_args()
+    if args:
+        op.error("Too many arguments")
+    if options.repeat < 1 or options.max_threads < 1:
+        op.error("--repeat and --max-threads must be at least 1")
+
+    os.chdir(os.path.dirname(os.path.realpath(__file__)))
+    try:
+        num_chunk_bits = read_num_chunk_bits()
+    except (IOError, ValueError):
+        op.error("Run set_input.py first, so input.h exists")
+
+    # Build settings, one thread
+    results = []
+    # A batch can't be wider than a chunk
+    bs_widths = [width for width in BS_WIDTHS if width <= 2**num_chunk_bits]
+    for arch_flags in ARCH_FLAGS:
+        for bs_width in bs_widths:
+            for interleave in INTERLEAVES:
+                for prefilter_sboxes in PREFILTER_SBOXES:
+                    settings = {
+                        "BS_WIDTH": bs_width,
+                        "INTERLEAVE": interleave,
+                        "PREFILTER_SBOXES": prefilter_sboxes,
+                        "ARCH_FLAGS": arch_flags,
+                    }
+                    try:
+                        build(settings)
+                    except CalledProcessError:
+                        print "%-72s build failed" % describe(settings)
+                        continue
+                    rate = keys_per_second(1, num_chunk_bits, options.repeat)
+                    results.append((rate, settings))
+                    print "%-72s %12.0f keys/second" % (describe(settings), rate)
+                    sys.stdout.flush()
+    if not results:
+        sys.exit("No build succeeded")
+    single_rate, best = max(results)
+    print "Fastest:", describe(best)
+    print
+
+    # Thread count, with the fastest build
+    build(best)
+    counts = [2**i for i in range(32) if 2**i < options.max_threads] + [options.max_threads]
+    total_rate, threads = 0, 1
+    for count in counts:
+        rate = keys_per_second(count, num_chunk_bits, options.repeat)
+        print "%3d threads %12.0f keys/second" % (count, rate)
+        sys.stdout.flush()
+        # More threads have to be clearly faster to be worth it
+        if rate > total_rate * 1.02:
+            total_rate, threads = rate, count
+    print "Fastest: %d threads" % threads
+
+    if not options.dry_run:
+        filename = options.output or tune_file_name()
+        write_tune_file(filename, best, threads, single_rate, total_rate, num_chunk_bits)
+        print "Wrote", filename
+        if not options.output:
+            print "Run make to rebuild with it."
@@ -0,0 +1,388 @@
+/*
+ * Checks keys made from candidate passwords against the input in input.h,
+ * instead of every key with a prefix like check_keys does.
+ *
+ * Candidates come from a wordlist or a mask, which gives a set of characters
+ * for each position (like "?u?l?l?l?d?d").  Each candidate is turned into a
+ * 56 bit key, BS_WIDTH at a time, then zipped and passed through the same
+ * kernel as check_keys.  Candidates are numbered so that a search can be
+ * split up with a start index and a count.
+ *
+ * Passwords become keys in one of these formats:
+ *   raw - The 8 characters are the DES key.  The low bit of each byte is a
+ *         parity bit, so characters that only differ in it give the same
+ *         key, and are only tried once in a mask.
+ *   shifted - Each character is shifted left one bit, so all 7 bits of
+ *             ASCII are used.  This is how crypt(3) does it.
+ *   lm - 7 characters of 8 bits each, which are spread over the 8 bytes of
+ *        the key, as LAN Manager does.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "check_keys.h"
+#include "parse.h"  // parse_number
+
+// Define plaintext_zipped, ciphertext_zipped, and NUM_CHUNK_BITS, the
+// extra_*_zipped arrays and NUM_EXTRA_PAIRS for more known pairs,
+// complement_zipped and COMPLEMENT_MODE for a complementary pair, or
+// predicate and CIPHERTEXT_ONLY_MODE when only ciphertext is known.  Uses
+// struct plaintext_predicate, so it must come after check_keys.h.
+#include "input.h"
+
+#define MAX_LENGTH 8
+#define MAX_LINE 1024
+
+struct key_format {
+    const char* name;
+    int length;  // Characters used
+    int bits;  // Key bits per character
+    int shift;  // Right shift applied to each character
+};
+
+static const struct key_format key_formats[] = {
+    {"raw",     8, 7, 1},
+    {"shifted", 8, 7, 0},
+    {"lm",      7, 8, 0},
+};
+
+// A mask is a set of characters for every position
+struct mask {
+    int length;
+    char charsets[MAX_LENGTH][256];
+    int sizes[MAX_LENGTH];
+};
+
+// The candidates in one batch, so found keys can be matched to passwords
+struct batch {
+    int size;
+    uint64_t keys[BS_WIDTH];
+    char passwords[BS_WIDTH][MAX_LENGTH+1];
+    uint64_t printed[BS_WIDTH];
+    int num_printed;
+};
+
+static const struct key_format* format;
+
+
+/***** Candidates *****/
+
+static uint64_t password_to_key(const char* password) {
+    uint64_t key = 0;
+    int ended = 0;
+    for (int i=0; i<format->length; i++) {
+        unsigned char c = ended ? '\0' : password[i];
+        ended = ended || c == '\0';  // Pad with zeros
+        key = key << format->bits | ((c >> format->shift) & ((1 << format->bits) - 1));
+    }
+    return key;
+}
+
+/*
+ * Parses a mask like "?u?l?l?d".  Returns -1 if it is invalid.  Characters
+ * that give the same key bits are only kept once.
+ */
+static int parse_mask(const char* text, struct mask* mask) {
+    mask->length = 0;
+    while (*text) {
+        if (mask->length == format->length) {
+            return -1;
+        }
+
+        char charset[256] = {0};
+        if (text[0] == '?' && text[1]) {
+            int first = 0x20, last = 0x7e;
+            switch (text[1]) {
+                case 'l': first = 'a'; last = 'z'; break;
+                case 'u': first = 'A'; last = 'Z'; break;
+                case 'd': first = '0'; last = '9'; break;
+                case 'a': break;
+                case 's': break;
+                case '?': first = last = '?'; break;
+                default: return -1;
+            }
+            int n = 0;
+            for (int c=first; c<=last; c++) {
+                if (text[1] == 's' && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+                    continue;
+                }
+                charset[n++] = c;
+            }
+            text += 2;
+        } else {
+            charset[0] = *text++;
+        }
+
+        // Drop characters with the same key bits as an earlier one
+        int* size = &mask->sizes[mask->length];
+        int seen[256] = {0};
+        *size = 0;
+        for (int i=0; charset[i]; i++) {
+            int bits = ((unsigned char) charset[i] >> format->shift) & ((1 << format->bits) - 1);
+            if (!seen[bits]) {
+                seen[bits] = 1;
+                mask->charsets[mask->length][(*size)++] = charset[i];
+            }
+        }
+        mask->length++;
+    }
+    return mask->length ? 0 : -1;
+}
+
+static uint64_t mask_size(const struct mask* mask) {
+    uint64_t size = 1;
+    for (int i=0; i<mask->length; i++) {
+        size *= mask->sizes[i];
+    }
+    return size;
+}
+
+/*
+ * Fills a batch with up to BS_WIDTH mask candidates, starting from the given
+ * index.  The last position changes fastest.
+ */
+static void mask_batch(const struct mask* mask, uint64_t index, int n, struct batch* batch) {
+    int digits[MAX_LENGTH];
+    for (int i=mask->length-1; i>=0; i--) {
+        digits[i] = index % mask->sizes[i];
+        index /= mask->sizes[i];
+    }
+
+    batch->size = n;
+    for (int lane=0; lane<n; lane++) {
+        char* password = batch->passwords[lane];
+        for (int i=0; i<mask->length; i++) {
+            password[i] = mask->charsets[i][digits[i]];
+        }
+        password[mask->length] = '\0';
+        batch->keys[lane] = password_to_key(password);
+
+        for (int i=mask->length-1; i>=0; i--) {
+            if (++digits[i] < mask->sizes[i]) {
+                break;
+            }
+            digits[i] = 0;
+        }
+    }
+}
+
+/*
+ * Fills a batch with up to BS_WIDTH words from a wordlist.  Returns the number
+ * read.
+ */
+static int wordlist_batch(FILE* f, int n, struct batch* batch) {
+    char line[MAX_LINE];
+    batch->size = 0;
+    while (batch->size < n && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* password = batch->passwords[batch->size];
+        strncpy(password, line, MAX_LENGTH);
+        password[MAX_LENGTH] = '\0';
+        batch->keys[batch->size] = password_to_key(password);
+        batch->size++;
+    }
+    return batch->size;
+}
+
+
+/***** Checking *****/
+
+static void print_key(uint64_t key, void* arg) {
+    struct batch* batch = arg;
+
+    // Unused lanes repeat the first key, so it can be reported many times
+    for (int i=0; i<batch->num_printed; i++) {
+        if (batch->printed[i] == key) {
+            return;
+        }
+    }
+    batch->printed[batch->num_printed++] = key;
+
+    for (int lane=0; lane<batch->size; lane++) {
+        if (batch->keys[lane] == key) {
+            printf("0x%014lx %s\n", key, batch->passwords[lane]);
+            return;
+        }
+    }
+    // The complement of a candidate, in complement mode
+    printf("0x%014lx\n", key);
+}
+
+static void check_batch(const struct key_search* search, struct batch* batch) {
+    uint64_t keys[64];
+    uint64_t words[64];
+    bs_t keys_zipped[64];
+
+    // Zipped 64 lanes at a time, each group into one word of the bs_ts
+    for (int word=0; word<BS_WORDS; word++) {
+        for (int i=0; i<64; i++) {
+            int lane = word*64 + i;
+            keys[i] = batch->keys[lane < batch->size ? lane : 0] << 8;
+        }
+        zip_64_bit(keys, words);
+        for (int i=0; i<64; i++) {
+            bs_set_word(&keys_zipped[i], word, words[i]);
+        }
+    }
+
+    batch->num_printed = 0;
+    check_key_batch(search, keys_zipped);
+}
+
+
+/***** Main *****/
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: check_candidates [options] (-w <wordlist> | -m <mask>) [<start> [<count>]]\n"
+        "\n"
+        "Checks keys made from candidate passwords against the input in input.h.\n"
+        "Candidates are numbered from 0.  Only count of them starting at start are\n"
+        "checked, or all of them by default.  Found keys are printed in hex without\n"
+        "parity bits, followed by the password.\n"
+        "\n"
+        "Options:\n"
+        "  -w WORDLIST  Candidates are the lines of WORDLIST (\"-\" for stdin).\n"
+        "  -m MASK      Candidates are every password matching MASK.  Each position\n"
+        "               is a literal character, or one of ?l (a-z), ?u (A-Z), ?d\n"
+        "               (0-9), ?s (symbols and space), ?a (all printable ASCII)\n"
+        "               or ?? (a question mark).\n"
+        "  -f FORMAT    How passwords become keys: raw (default), shifted or lm.\n"
+        "  -n           Print the number of candidates and exit.\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+
+    const char* wordlist_name = NULL;
+    const char* mask_text = NULL;
+    int count_only = 0;
+    format = &key_formats[0];
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:m:f:nh")) != -1) {
+        switch (opt) {
+            case 'w':
+                wordlist_name = optarg;
+                break;
+            case 'm':
+                mask_text = optarg;
+                break;
+            case 'f':
+                format = NULL;
+                for (size_t i=0; i<sizeof(key_formats)/sizeof(key_formats[0]); i++) {
+                    if (!strcmp(optarg, key_formats[i].name)) {
+                        format = &key_formats[i];
+                    }
+                }
+                if (!format) {
+                    usage();
+                }
+                break;
+            case 'n':
+                count_only = 1;
+                break;
+            default:
+                usage();
+        }
+    }
+    argv += optind;
+    argc -= optind;
+    if (!wordlist_name == !mask_text || argc > 2) {
+        usage();
+    }
+    uint64_t start = argc > 0 ? parse_number(argv[0], 10) : 0;
+    uint64_t count = argc > 1 ? parse_number(argv[1], 10) : UINT64_MAX;
+
+    struct batch batch;
+    const struct key_search search = {
+#ifdef CIPHERTEXT_ONLY_MODE
+        .predicate = &predicate,
+#else
+        .plaintext_zipped = plaintext_zipped,
+        .ciphertext_zipped = ciphertext_zipped,
+#endif
+#ifdef NUM_EXTRA_PAIRS
+        .num_extra_pairs = NUM_EXTRA_PAIRS,
+        .extra_plaintexts_zipped = extra_plaintexts_zipped,
+        .extra_ciphertexts_zipped = extra_ciphertexts_zipped,
+#endif
+#ifdef COMPLEMENT_MODE
+        .complement_zipped = complement_zipped,
+#endif
+        .num_chunk_bits = NUM_CHUNK_BITS,
+        .found_key = print_key,
+        .found_key_arg = &batch
+    };
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    uint64_t checked = 0;
+
+    if (mask_text) {
+
+        struct mask mask;
+        if (parse_mask(mask_text, &mask)) {
+            fprintf(stderr, "Invalid mask.  At most %d positions for the %s format.\n",
+                    format->length, format->name);
+            return 2;
+        }
+        uint64_t total = mask_size(&mask);
+        if (count_only) {
+            printf("%lu\n", total);
+            return 0;
+        }
+        uint64_t end = start + count < start || start + count > total ? total : start + count;
+        for (uint64_t index=start; index<end; index+=BS_WIDTH) {
+            mask_batch(&mask, index, end - index < BS_WIDTH ? end - index : BS_WIDTH, &batch);
+            check_batch(&search, &batch);
+            checked += batch.size;
+        }
+
+    } else {
+
+        FILE* f = strcmp(wordlist_name, "-") ? fopen(wordlist_name, "r") : stdin;
+        if (!f) {
+            fprintf(stderr, "Could not open \"%s\"\n", wordlist_name);
+            return 1;
+        }
+        char line[MAX_LINE];
+        uint64_t skipped = 0;
+        while (skipped < start && fgets(line, sizeof(line), f)) {
+            if (strchr(line, '\n')) {
+                skipped++;
+            }
+        }
+        if (count_only) {
+            uint64_t total = skipped;
+            while (fgets(line, sizeof(line), f)) {
+                total += strchr(line, '\n') != NULL;
+            }
+            printf("%lu\n", total);
+            return 0;
+        }
+        while (checked < count &&
+                wordlist_batch(f, count - checked < BS_WIDTH ? count - checked : BS_WIDTH, &batch)) {
+            check_batch(&search, &batch);
+            checked += batch.size;
+        }
+
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    fprintf(stderr, "Checked %lu candidates in %.1f seconds", checked, seconds);
+    if (seconds > 0) {
+        fprintf(stderr, " (%.0f keys/second)", checked / seconds);
+    }
+    fprintf(stderr, "\n");
+
+}
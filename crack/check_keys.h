@@ -0,0 +1,837 @@
+/*
+ * The key search kernel used by check_keys and native_worker.
+ *
+ * Ideas originally taken from this research paper by Eli Biham:
+ *     "A Fast New DES Implementation in Software"
+ * Specifically, Biham pointed out that 64 encryptions can be done in
+ * parallel on 64 bit machines, and S-Boxes can be calculated with
+ * simple gate logic.
+ *
+ * Everything here works on bs_t (see bitslice.h), so BS_WIDTH keys are
+ * checked per batch.  Lane l holds the key whose low BS_WIDTH_BITS bits are
+ * l: bits 0 to 5 come from the lane within its 64 bit word, the rest from
+ * the word.  The plaintexts and ciphertexts are the same for every key, so
+ * they stay uint64_t arrays of all 0s or all 1s, as set_input.py writes
+ * them, and are broadcast to bs_t where they're used.
+ *
+ * Nothing in here depends on input.h.  The plaintext, ciphertext and chunk
+ * size are passed in through a struct key_search, so the same kernel can be
+ * called from several threads at once.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bitslice.h"  // bs_t
+#include "sbox.h"  // s-boxes: s0 to s7
+
+// Instrumentation hooks, defined by perf.h.  Unless it is included first,
+// they compile to nothing.
+#ifndef INSTRUMENT_BATCH
+#define INSTRUMENT_CHUNK_START()
+#define INSTRUMENT_BATCH()
+#define INSTRUMENT_BATCH_END()
+#define INSTRUMENT_PHASE_START(phase)
+#define INSTRUMENT_PHASE_END(phase)
+#endif
+
+static const unsigned char feistel_output_order[32] = {
+     8, 16, 22, 30, 12, 27,  1, 17,
+    23, 15, 29,  5, 25, 19,  9,  0,
+     7, 13, 24,  2,  3, 28, 10, 18,
+    31, 11, 21,  6,  4, 26, 14, 20
+};
+
+/*
+ * Each of these 16 arrays represents which bits from the key make up the ith
+ * subkey.  These indexes are based on a 56 bit key (with the parity bits taken
+ * out).  The subkey order is reversed for decryption.
+ */
+static const unsigned char key_bit_orders[16][48] = {
+    {  // Subkey 15
+         15, 51, 36,  2, 49, 21,
+         35, 31,  8, 14, 23, 43,
+          9, 37, 29, 28, 45,  0,
+          1,  7, 38, 30, 22, 42,
+         26,  4, 41, 54, 39, 10,
+         48, 33, 11, 53, 27, 32,
+          5, 25, 40,  3, 20, 24,
+         46, 19, 18,  6, 55, 34,
+    },
+    {  // Subkey 14
+         22,  1, 43,  9, 31, 28,
+         42, 38, 15, 21, 30, 50,
+         16, 44, 36, 35, 52,  7,
+          8, 14, 45, 37, 29, 49,
+         33, 11, 48,  6, 46, 17,
+         55, 40, 18,  5, 34, 39,
+         12, 32, 47, 10, 27,  4,
+         53, 26, 25, 13,  3, 41,
+    },
+    {  // Subkey 13
+         36, 15,  0, 23, 45, 42,
+         31, 52, 29, 35, 44,  7,
+         30,  1, 50, 49,  9, 21,
+         22, 28,  2, 51, 43, 38,
+         47, 25,  3, 20,  5,  4,
+         10, 54, 32, 19, 48, 53,
+         26, 46,  6, 24, 41, 18,
+         12, 40, 39, 27, 17, 55,
+    },
+    {  // Subkey 12
+         50, 29, 14, 37,  2, 31,
+         45,  9, 43, 49,  1, 21,
+         44, 15,  7, 38, 23, 35,
+         36, 42, 16,  8,  0, 52,
+          6, 39, 17, 34, 19, 18,
+         24, 13, 46, 33,  3, 12,
+         40,  5, 20, 11, 55, 32,
+         26, 54, 53, 41,  4, 10,
+    },
+    {  // Subkey 11
+          7, 43, 28, 51, 16, 45,
+          2, 23,  0, 38, 15, 35,
+          1, 29, 21, 52, 37, 49,
+         50, 31, 30, 22, 14,  9,
+         20, 53,  4, 48, 33, 32,
+         11, 27,  5, 47, 17, 26,
+         54, 19, 34, 25, 10, 46,
+         40, 13, 12, 55, 18, 24,
+    },
+    {  // Subkey 10
+         21,  0, 42,  8, 30,  2,
+         16, 37, 14, 52, 29, 49,
+         15, 43, 35,  9, 51, 38,
+          7, 45, 44, 36, 28, 23,
+         34, 12, 18,  3, 47, 46,
+         25, 41, 19,  6,  4, 40,
+         13, 33, 48, 39, 24,  5,
+         54, 27, 26, 10, 32, 11,
+    },
+    {  // Subkey 9
+         35, 14, 31, 22, 44, 16,
+         30, 51, 28,  9, 43, 38,
+         29,  0, 49, 23,  8, 52,
+         21,  2,  1, 50, 42, 37,
+         48, 26, 32, 17,  6,  5,
+         39, 55, 33, 20, 18, 54,
+         27, 47,  3, 53, 11, 19,
+         13, 41, 40, 24, 46, 25,
+    },
+    {  // Subkey 8
+         49, 28, 45, 36,  1, 30,
+         44,  8, 42, 23,  0, 52,
+         43, 14, 38, 37, 22,  9,
+         35, 16, 15,  7, 31, 51,
+          3, 40, 46,  4, 20, 19,
+         53, 10, 47, 34, 32, 13,
+         41,  6, 17, 12, 25, 33,
+         27, 55, 54, 11,  5, 39,
+    },
+    {  // Subkey 7
+         31, 35, 52, 43,  8, 37,
+         51, 15, 49, 30,  7,  2,
+         50, 21, 45, 44, 29, 16,
+         42, 23, 22, 14, 38,  1,
+         10, 47, 53, 11, 27, 26,
+          5, 17, 54, 41, 39, 20,
+         48, 13, 24, 19, 32, 40,
+         34,  3,  6, 18, 12, 46,
+    },
+    {  // Subkey 6
+         45, 49,  9,  0, 22, 51,
+          8, 29, 38, 44, 21, 16,
+          7, 35,  2,  1, 43, 30,
+         31, 37, 36, 28, 52, 15,
+         24,  6, 12, 25, 41, 40,
+         19,  4, 13, 55, 53, 34,
+          3, 27, 11, 33, 46, 54,
+         48, 17, 20, 32, 26,  5,
+    },
+    {  // Subkey 5
+          2, 38, 23, 14, 36,  8,
+         22, 43, 52,  1, 35, 30,
+         21, 49, 16, 15,  0, 44,
+         45, 51, 50, 42,  9, 29,
+         11, 20, 26, 39, 55, 54,
+         33, 18, 27, 10, 12, 48,
+         17, 41, 25, 47,  5, 13,
+          3,  4, 34, 46, 40, 19,
+    },
+    {  // Subkey 4
+         16, 52, 37, 28, 50, 22,
+         36,  0,  9, 15, 49, 44,
+         35, 38, 30, 29, 14,  1,
+          2,  8,  7, 31, 23, 43,
+         25, 34, 40, 53, 10, 13,
+         47, 32, 41, 24, 26,  3,
+          4, 55, 39,  6, 19, 27,
+         17, 18, 48,  5, 54, 33,
+    },
+    {  // Subkey 3
+         30,  9, 51, 42,  7, 36,
+         50, 14, 23, 29, 38,  1,
+         49, 52, 44, 43, 28, 15,
+         16, 22, 21, 45, 37,  0,
+         39, 48, 54, 12, 24, 27,
+          6, 46, 55, 11, 40, 17,
+         18, 10, 53, 20, 33, 41,
+          4, 32,  3, 19, 13, 47,
+    },
+    {  // Subkey 2
+         44, 23,  8, 31, 21, 50,
+          7, 28, 37, 43, 52, 15,
+         38,  9,  1,  0, 42, 29,
+         30, 36, 35,  2, 51, 14,
+         53,  3, 13, 26, 11, 41,
+         20,  5, 10, 25, 54,  4,
+         32, 24, 12, 34, 47, 55,
+         18, 46, 17, 33, 27,  6,
+    },
+    {  // Subkey 1
+          1, 37, 22, 45, 35,  7,
+         21, 42, 51,  0,  9, 29,
+         52, 23, 15, 14, 31, 43,
+         44, 50, 49, 16,  8, 28,
+         12, 17, 27, 40, 25, 55,
+         34, 19, 24, 39, 13, 18,
+         46, 11, 26, 48,  6, 10,
+         32,  5,  4, 47, 41, 20,
+    },
+    {  // Subkey 0
+          8, 44, 29, 52, 42, 14,
+         28, 49,  1,  7, 16, 36,
+          2, 30, 22, 21, 38, 50,
+         51,  0, 31, 23, 15, 35,
+         19, 24, 34, 47, 32,  3,
+         41, 26,  4, 46, 20, 25,
+         53, 18, 33, 55, 13, 17,
+         39, 12, 11, 54, 48, 27,
+    }
+};
+
+/*
+ * A test on the plaintext, for when it isn't known exactly (ciphertext only).
+ * Bit positions are slice indexes into the output of des_decrypt, which has
+ * the initial permutation applied and the block halves switched.  See
+ * set_input.py.
+ */
+struct plaintext_predicate {
+
+    // Ciphertext blocks with the initial permutation applied, in zipped
+    // format.  Only keys that pass on the first block are tested on the
+    // next, so extra blocks cost almost nothing.
+    int num_blocks;
+    const uint64_t (*blocks_zipped)[64];
+
+    // Xored into the decryption of each block before testing it.  In CBC
+    // mode this is the previous ciphertext block, preprocessed like a
+    // plaintext.  All zeros otherwise.
+    const uint64_t (*chaining_zipped)[64];
+
+    // Plaintext bits that are known, and their values (in known_zipped).
+    int num_known_bits;
+    const unsigned char* known_bits;
+    const uint64_t* known_zipped;
+
+    // If set, every byte must be printable ASCII (0x20 to 0x7e).  Bit j
+    // (most significant first) of byte i is byte_bits[i][j].
+    int printable;
+    const unsigned char (*byte_bits)[8];
+
+};
+
+/*
+ * Describes one key search.  Everything the kernel needs is in here, so
+ * different threads can run searches at the same time, as long as each has
+ * its own keys_zipped.
+ */
+struct key_search {
+
+    // Plaintext with the initial permutation applied and the block halves
+    // switched, in zipped format.  See set_input.py.
+    const uint64_t* plaintext_zipped;
+
+    // Ciphertext with the initial permutation applied, in zipped format.
+    const uint64_t* ciphertext_zipped;
+
+    // More plaintext-ciphertext pairs, preprocessed the same way.  Keys that
+    // match the first pair are only reported if they match these too.
+    int num_extra_pairs;
+    const uint64_t (*extra_plaintexts_zipped)[64];
+    const uint64_t (*extra_ciphertexts_zipped)[64];
+
+    // Complementation mode, used when the pair is chosen plaintext.  Since
+    // E_~k(~p) = ~E_k(p), if the encryption c2 of ~p is known too, one
+    // encryption of p under k checks both k and ~k.  So half of the keyspace
+    // only needs to be searched.
+    //
+    // When this is not NULL, the roles are reversed to encrypt instead of
+    // decrypt: plaintext_zipped must have only the initial permutation
+    // applied, ciphertext_zipped must also have the halves switched, and
+    // complement_zipped is ~c2 preprocessed the same way as
+    // ciphertext_zipped.  See set_input.py.
+    const uint64_t* complement_zipped;
+
+    // Ciphertext only mode.  When this is not NULL, plaintext_zipped and
+    // ciphertext_zipped aren't used.  Instead, keys are reported when the
+    // decryption of every block passes the predicate.
+    const struct plaintext_predicate* predicate;
+
+    // Number of key bits a single call to check_key_chunk searches.
+    int num_chunk_bits;
+
+    // Called with the 56 bit key (parity bits taken out) for every match.
+    void (*found_key)(uint64_t key, void* arg);
+    void* found_key_arg;
+
+};
+
+/*
+ * Take 64 integers of length 64 and put the ith bit of input[j] into
+ * the jth bit of output[i].  Think of this as writing every single bit
+ * into a 64x64 matrix, then transposing that matrix.  Consequently,
+ * function is its own inverse.
+ *
+ * The transpose is done recursively: swap the top right and bottom left
+ * 32x32 blocks, then do the same inside every 32x32 block at once, and so
+ * on down to single bits.  That's 6 passes over 32 pairs of rows instead of
+ * touching every bit, which matters when candidate keys are zipped for
+ * every batch (see check_candidates.c).
+ */
+inline static void zip_64_bit(const uint64_t input[64], uint64_t output[64]) {
+    uint64_t mask = 0x00000000ffffffffLL;
+    memcpy(output, input, 64*8);
+    for (int width=32; width; width >>= 1, mask ^= mask << width) {
+        for (int i=0; i<64; i = (i + width + 1) & ~width) {
+            uint64_t swap = (output[i] ^ (output[i+width] >> width)) & mask;
+            output[i] ^= swap;
+            output[i+width] ^= swap << width;
+        }
+    }
+}
+
+/*
+ * Computes sboxes first_sbox to last_sbox-1 of the feistel function, which
+ * fill in the output bits given by feistel_output_order[first_sbox*4] to
+ * feistel_output_order[last_sbox*4-1].  Every call but the prefilter's (see
+ * des_decrypt_prefilter) computes all 8.
+ *
+ * block_bits, key_bits and output hold interleave independent batches one
+ * after another (64, 56 and 32 slices apart).  Each sbox is computed for
+ * every batch before moving on to the next sbox, so the compiler and the CPU
+ * have several gate chains with no dependencies between them to overlap,
+ * while only one sbox's worth of temporaries per batch is live at a time.
+ * interleave is always a constant, so the loop is unrolled away.
+ */
+static void des_feistel(const bs_t* block_bits, const bs_t* key_bits, bs_t* output, const int roundnum, const unsigned char key_bit_order[48], const int first_sbox, const int last_sbox, const int interleave) {
+
+    // Either 0 (left block) or 32 (right block) depending on the round
+    #define BLOCK_START(roundnum) ( (roundnum+1)%2 * 32 )
+
+    // Gives the feistel expansion of the left or right block (depending on the
+    // round).  Rather than giving an integer from 0-47 for each expansion
+    // output bit, the sbox that the input is needed for is given.
+    //   snum - An integer from 0-7 specifying which sbox to get the inputs of.
+    //   i - An integer from 0-5 specifying which input from the sbox to get.
+    #define EXPANDED(snum, i, roundnum) ( block_bits[b*64 + (snum*4 + (i+31)%32) % 32 + BLOCK_START(roundnum)] )
+
+    // Gets the key bit i from round roundnum.
+    #define KEY_BIT(roundnum, i) ( key_bits[b*56 + key_bit_order[i]] )
+
+    // Call an sbox for every batch
+    #define S(snum) \
+        if (snum >= first_sbox && snum < last_sbox) for (int b=0; b<interleave; b++) s ## snum ( \
+            EXPANDED(snum, 0, roundnum) ^ KEY_BIT(roundnum, snum*6 + 0), \
+            EXPANDED(snum, 1, roundnum) ^ KEY_BIT(roundnum, snum*6 + 1), \
+            EXPANDED(snum, 2, roundnum) ^ KEY_BIT(roundnum, snum*6 + 2), \
+            EXPANDED(snum, 3, roundnum) ^ KEY_BIT(roundnum, snum*6 + 3), \
+            EXPANDED(snum, 4, roundnum) ^ KEY_BIT(roundnum, snum*6 + 4), \
+            EXPANDED(snum, 5, roundnum) ^ KEY_BIT(roundnum, snum*6 + 5), \
+            &output[b*32 + feistel_output_order[snum*4 + 0]], \
+            &output[b*32 + feistel_output_order[snum*4 + 1]], \
+            &output[b*32 + feistel_output_order[snum*4 + 2]], \
+            &output[b*32 + feistel_output_order[snum*4 + 3]] \
+        );
+
+    S(0);
+    S(1);
+    S(2);
+    S(3);
+    S(4);
+    S(5);
+    S(6);
+    S(7);
+
+    #undef BLOCK_START
+    #undef EXPANDED
+    #undef KEY_BIT
+    #undef S
+
+}
+
+/*
+ * Calls ROUND(0) through ROUND(15), which must be defined first.  Block
+ * halves are never switched, instead the half that is used alternates each
+ * round.
+ */
+#define ALL_ROUNDS() \
+    FIRST_14_ROUNDS() \
+    ROUND(14); \
+    ROUND(15);
+
+#define FIRST_14_ROUNDS() \
+    ROUND(0); \
+    ROUND(1); \
+    ROUND(2); \
+    ROUND(3); \
+    ROUND(4); \
+    ROUND(5); \
+    ROUND(6); \
+    ROUND(7); \
+    ROUND(8); \
+    ROUND(9); \
+    ROUND(10); \
+    ROUND(11); \
+    ROUND(12); \
+    ROUND(13);
+
+inline static void des_decrypt(bs_t ciphertext_bits[64], const bs_t key_bits[56]) {
+
+    bs_t feistel_output[32];
+    #define ROUND(roundnum) \
+        des_feistel(ciphertext_bits, key_bits, feistel_output, roundnum, key_bit_orders[roundnum], 0, 8, 1); \
+        for (int i=0; i<32; i++) { \
+            ciphertext_bits[i + (roundnum%2 * 32)] ^= feistel_output[i]; \
+        }
+
+    ALL_ROUNDS();
+
+    #undef ROUND
+
+}
+
+/*
+ * Decryption, stopped as soon as some output bits are final.
+ *
+ * The last round only changes the right half, so the left half is final
+ * after round 14, and each of its sboxes finalizes 4 output bits by itself.
+ * des_decrypt_prefilter does rounds 0 to 13 and only the first
+ * NUM_PREFILTER_SBOXES sboxes of round 14, which is enough to compare
+ * 4*NUM_PREFILTER_SBOXES bits (see compare_prefilter).  Almost every batch of
+ * keys is rejected there, skipping the rest of round 14 and all of round 15.
+ * For the rare batch that isn't, des_decrypt_finish does the rest.
+ */
+#ifndef NUM_PREFILTER_SBOXES
+#define NUM_PREFILTER_SBOXES 3
+#endif
+
+/*
+ * Number of 64 key batches check_key_chunk carries through the prefilter
+ * together (see des_feistel).  1, 2 or 4.  Which is fastest depends on the
+ * microarchitecture: more independent work per sbox hides latency, but past
+ * the number of registers the temporaries spill to memory.  Set with
+ * "make INTERLEAVE=n".
+ */
+#ifndef INTERLEAVE
+#define INTERLEAVE 1
+#endif
+
+inline static void des_decrypt_prefilter(bs_t* ciphertext_bits, const bs_t* key_bits, const int interleave) {
+
+    bs_t feistel_output[32*INTERLEAVE];
+    #define ROUND(roundnum) \
+        des_feistel(ciphertext_bits, key_bits, feistel_output, roundnum, key_bit_orders[roundnum], 0, 8, interleave); \
+        for (int b=0; b<interleave; b++) { \
+            for (int i=0; i<32; i++) { \
+                ciphertext_bits[b*64 + i + (roundnum%2 * 32)] ^= feistel_output[b*32 + i]; \
+            } \
+        }
+
+    FIRST_14_ROUNDS();
+
+    #undef ROUND
+
+    des_feistel(ciphertext_bits, key_bits, feistel_output, 14, key_bit_orders[14], 0, NUM_PREFILTER_SBOXES, interleave);
+    for (int b=0; b<interleave; b++) {
+        for (int i=0; i<NUM_PREFILTER_SBOXES*4; i++) {
+            ciphertext_bits[b*64 + feistel_output_order[i]] ^= feistel_output[b*32 + feistel_output_order[i]];
+        }
+    }
+
+}
+
+inline static void des_decrypt_finish(bs_t ciphertext_bits[64], const bs_t key_bits[56]) {
+
+    bs_t feistel_output[32];
+
+    des_feistel(ciphertext_bits, key_bits, feistel_output, 14, key_bit_orders[14], NUM_PREFILTER_SBOXES, 8, 1);
+    for (int i=NUM_PREFILTER_SBOXES*4; i<32; i++) {
+        ciphertext_bits[feistel_output_order[i]] ^= feistel_output[feistel_output_order[i]];
+    }
+
+    des_feistel(ciphertext_bits, key_bits, feistel_output, 15, key_bit_orders[15], 0, 8, 1);
+    for (int i=0; i<32; i++) {
+        ciphertext_bits[i + 32] ^= feistel_output[i];
+    }
+
+}
+
+/*
+ * Encryption is the same as decryption with the subkeys reversed.  The
+ * plaintext must have the initial permutation applied (halves not switched),
+ * and the result is the ciphertext with the initial permutation applied and
+ * the halves switched.  That's the reverse of what des_decrypt expects.
+ */
+inline static void des_encrypt(bs_t plaintext_bits[64], const bs_t key_bits[56]) {
+
+    bs_t feistel_output[32];
+    #define ROUND(roundnum) \
+        des_feistel(plaintext_bits, key_bits, feistel_output, roundnum, key_bit_orders[15-roundnum], 0, 8, 1); \
+        for (int i=0; i<32; i++) { \
+            plaintext_bits[i + (roundnum%2 * 32)] ^= feistel_output[i]; \
+        }
+
+    ALL_ROUNDS();
+
+    #undef ROUND
+
+}
+
+// Broadcasts a preprocessed block (see struct key_search) to every lane
+inline static void load_block(bs_t output[64], const uint64_t block[64]) {
+    for (int i=0; i<64; i++) {
+        output[i] = bs_broadcast(block[i]);
+    }
+}
+
+/*
+ * Compares a zipped block to a preprocessed one.  Returns a bs_t in which
+ * each 0 represents a match for that lane.
+ */
+inline static bs_t compare(const bs_t a[64], const uint64_t b[64]) {
+    bs_t result = BS_ZERO;
+    for (int i=0; i<64; i++) {
+        result |= a[i] ^ bs_broadcast(b[i]);
+        if (bs_all_ones(result)) {
+            return result;
+        }
+
+    }
+    return result;
+}
+
+/*
+ * Like compare, but only for the bits des_decrypt_prefilter finalizes.
+ */
+inline static bs_t compare_prefilter(const bs_t a[64], const uint64_t b[64]) {
+    bs_t result = BS_ZERO;
+    for (int i=0; i<NUM_PREFILTER_SBOXES*4; i++) {
+        result |= a[feistel_output_order[i]] ^ bs_broadcast(b[feistel_output_order[i]]);
+        if (bs_all_ones(result)) {
+            return result;
+        }
+    }
+    return result;
+}
+
+/*
+ * Tests a decryption against a predicate.  Like compare, returns a bs_t in
+ * which each 0 represents a pass.  Lanes set in result already failed.
+ */
+inline static bs_t test_predicate(const struct plaintext_predicate* predicate, const bs_t decrypted[64], const uint64_t chaining[64], bs_t result) {
+    for (int i=0; i<predicate->num_known_bits; i++) {
+        int bit = predicate->known_bits[i];
+        result |= decrypted[bit] ^ bs_broadcast(chaining[bit] ^ predicate->known_zipped[bit]);
+        if (bs_all_ones(result)) {
+            return result;
+        }
+    }
+    if (predicate->printable) {
+        for (int byte=0; byte<8; byte++) {
+            bs_t b[8];
+            for (int j=0; j<8; j++) {
+                int bit = predicate->byte_bits[byte][j];
+                b[j] = decrypted[bit] ^ bs_broadcast(chaining[bit]);
+            }
+            // High bit clear, one of the next two set, and not 0x7f
+            result |= b[0] | ~(b[1] | b[2]) | (b[1] & b[2] & b[3] & b[4] & b[5] & b[6] & b[7]);
+            if (bs_all_ones(result)) {
+                return result;
+            }
+        }
+    }
+    return result;
+}
+
+/*
+ * Calls search->found_key for each key where comparison has a 0.  If
+ * complement is set, the complement of those keys is reported instead.
+ * Keys are unzipped one 64 bit word of lanes at a time, and only for words
+ * with a match.
+ */
+static void report_keys(const struct key_search* search, const bs_t keys_zipped[56], bs_t comparison, int complement) {
+    uint64_t keys[64];
+    uint64_t padded[64] = {0};
+    uint64_t key_mask = complement ? 0x00ffffffffffffffLL : 0;
+
+    for (int word=0; word<BS_WORDS; word++) {
+        uint64_t matches = ~bs_get_word(comparison, word);
+        if (!matches) {
+            continue;
+        }
+        for (int i=0; i<56; i++) {
+            padded[i] = bs_get_word(keys_zipped[i], word);
+        }
+        zip_64_bit(padded, keys);
+        for (int i=0; i<64; i++) {
+            if (matches & 0x8000000000000000LL) {
+                search->found_key((keys[i]>>8) ^ key_mask, search->found_key_arg);
+            }
+            matches <<= 1;
+        }
+    }
+}
+
+/*
+ * Finishes checking a batch that des_decrypt_prefilter has been run on.
+ */
+static void check_prefiltered(const struct key_search* search, bs_t temp[64], const bs_t keys_zipped[56]) {
+
+    INSTRUMENT_PHASE_START(COMPARE);
+    bs_t comparison = compare_prefilter(temp, search->plaintext_zipped);
+    INSTRUMENT_PHASE_END(COMPARE);
+    if (bs_all_ones(comparison)) {
+        return;
+    }
+
+    INSTRUMENT_PHASE_START(DECRYPT);
+    des_decrypt_finish(temp, keys_zipped);
+    INSTRUMENT_PHASE_END(DECRYPT);
+    // temp is now plaintext zipped
+    INSTRUMENT_PHASE_START(COMPARE);
+    comparison |= compare(temp, search->plaintext_zipped);
+    INSTRUMENT_PHASE_END(COMPARE);
+
+    // Verify the survivors with the other pairs
+    for (int pair=0; pair<search->num_extra_pairs && !bs_all_ones(comparison); pair++) {
+        load_block(temp, search->extra_ciphertexts_zipped[pair]);
+        INSTRUMENT_PHASE_START(DECRYPT);
+        des_decrypt(temp, keys_zipped);
+        INSTRUMENT_PHASE_END(DECRYPT);
+        INSTRUMENT_PHASE_START(COMPARE);
+        comparison |= compare(temp, search->extra_plaintexts_zipped[pair]);
+        INSTRUMENT_PHASE_END(COMPARE);
+    }
+
+    if (!bs_all_ones(comparison)) {
+        report_keys(search, keys_zipped, comparison, 0);
+    }
+}
+
+static void check_key_batch(const struct key_search* search, const bs_t keys_zipped[56]) {
+    bs_t temp[64];
+
+    if (search->complement_zipped) {
+
+        load_block(temp, search->plaintext_zipped);
+
+        INSTRUMENT_PHASE_START(DECRYPT);
+        des_encrypt(temp, keys_zipped);
+        INSTRUMENT_PHASE_END(DECRYPT);
+        // temp is now ciphertext zipped
+
+        INSTRUMENT_PHASE_START(COMPARE);
+        bs_t comparison = compare(temp, search->ciphertext_zipped);
+        bs_t complement_comparison = compare(temp, search->complement_zipped);
+        INSTRUMENT_PHASE_END(COMPARE);
+        if (!bs_all_ones(comparison)) {
+            report_keys(search, keys_zipped, comparison, 0);
+        }
+        if (!bs_all_ones(complement_comparison)) {
+            report_keys(search, keys_zipped, complement_comparison, 1);
+        }
+
+        return;
+    }
+
+    if (search->predicate) {
+        const struct plaintext_predicate* predicate = search->predicate;
+
+        load_block(temp, predicate->blocks_zipped[0]);
+
+        INSTRUMENT_PHASE_START(DECRYPT);
+        des_decrypt(temp, keys_zipped);
+        INSTRUMENT_PHASE_END(DECRYPT);
+
+        INSTRUMENT_PHASE_START(COMPARE);
+        bs_t comparison = test_predicate(predicate, temp, predicate->chaining_zipped[0], BS_ZERO);
+        INSTRUMENT_PHASE_END(COMPARE);
+
+        // Verify the survivors on the other blocks
+        for (int block=1; block<predicate->num_blocks && !bs_all_ones(comparison); block++) {
+            load_block(temp, predicate->blocks_zipped[block]);
+            INSTRUMENT_PHASE_START(DECRYPT);
+            des_decrypt(temp, keys_zipped);
+            INSTRUMENT_PHASE_END(DECRYPT);
+            INSTRUMENT_PHASE_START(COMPARE);
+            comparison = test_predicate(predicate, temp, predicate->chaining_zipped[block], comparison);
+            INSTRUMENT_PHASE_END(COMPARE);
+        }
+        if (!bs_all_ones(comparison)) {
+            report_keys(search, keys_zipped, comparison, 0);
+        }
+
+        return;
+    }
+
+    //TODO: Try rearranging things so this copy isn't needed.
+    load_block(temp, search->ciphertext_zipped);
+
+    INSTRUMENT_PHASE_START(DECRYPT);
+    des_decrypt_prefilter(temp, keys_zipped, 1);
+    INSTRUMENT_PHASE_END(DECRYPT);
+
+    check_prefiltered(search, temp, keys_zipped);
+}
+
+/*
+ * Like check_key_batch, but for INTERLEAVE batches of keys at once.
+ */
+static void check_keys_interleaved(const struct key_search* search, const bs_t keys_zipped[INTERLEAVE][56]) {
+    bs_t temp[INTERLEAVE][64];
+
+    // Only the common case is interleaved
+    if (INTERLEAVE == 1 || search->complement_zipped || search->predicate) {
+        for (int b=0; b<INTERLEAVE; b++) {
+            check_key_batch(search, keys_zipped[b]);
+        }
+        return;
+    }
+
+    for (int b=0; b<INTERLEAVE; b++) {
+        load_block(temp[b], search->ciphertext_zipped);
+    }
+
+    INSTRUMENT_PHASE_START(DECRYPT);
+    des_decrypt_prefilter(temp[0], keys_zipped[0], INTERLEAVE);
+    INSTRUMENT_PHASE_END(DECRYPT);
+
+    for (int b=0; b<INTERLEAVE; b++) {
+        check_prefiltered(search, temp[b], keys_zipped[b]);
+    }
+}
+
+static void check_key_chunk(const struct key_search* search, bs_t keys_zipped[56]) {
+    const int num_chunk_bits = search->num_chunk_bits;
+    const uint64_t num_batches = 1ULL << (num_chunk_bits-BS_WIDTH_BITS);
+    bs_t batch_keys[INTERLEAVE][56];
+    INSTRUMENT_CHUNK_START();
+    for (uint64_t i=0; i < num_batches; i += INTERLEAVE) {
+        int n = num_batches - i < INTERLEAVE ? num_batches - i : INTERLEAVE;
+        INSTRUMENT_BATCH();
+
+        // Take the next n batches, incrementing keys_zipped after each.
+        // These slices are the same in every lane, so one word of each is
+        // enough to tell whether it carries.
+        INSTRUMENT_PHASE_START(INCREMENT);
+        for (int b=0; b<n; b++) {
+            memcpy(batch_keys[b], keys_zipped, 56*sizeof(bs_t));
+            for (int j=56-num_chunk_bits; j<56-BS_WIDTH_BITS; j++) {
+                keys_zipped[j] = ~keys_zipped[j];
+                if (bs_get_word(keys_zipped[j], 0)) {
+                    break;
+                }
+            }
+        }
+        INSTRUMENT_PHASE_END(INCREMENT);
+
+        if (n == INTERLEAVE) {
+            check_keys_interleaved(search, (const bs_t (*)[56]) batch_keys);
+        } else {
+            for (int b=0; b<n; b++) {
+                check_key_batch(search, batch_keys[b]);
+            }
+        }
+        INSTRUMENT_BATCH_END();
+
+    }
+}
+
+/*
+ * Initialize keys_zipped to the first BS_WIDTH keys of the chunk given by
+ * prefix.
+ *
+ * The low BS_WIDTH_BITS key bits are set to the lane number (zipped), so
+ * after every call to check_key_batch the keys are all incremented by
+ * BS_WIDTH.  The most significant (56-num_chunk_bits) bits are set based on
+ * prefix.  Each char in prefix is '0' or '1' specifying what that bit for
+ * every key will be set to.
+ *
+ * Returns 0 on success, or -1 if prefix is the wrong length or not binary,
+ * or if num_chunk_bits is less than BS_WIDTH_BITS.
+ */
+static int set_key_prefix(bs_t keys_zipped[56], const char* prefix, int num_chunk_bits) {
+    static const uint64_t low_bits[6] = {
+        0x00000000ffffffffLL, 0x0000ffff0000ffffLL, 0x00ff00ff00ff00ffLL,
+        0x0f0f0f0f0f0f0f0fLL, 0x3333333333333333LL, 0x5555555555555555LL
+    };
+
+    if (num_chunk_bits < BS_WIDTH_BITS || strlen(prefix) != (size_t) (56-num_chunk_bits)) {
+        return -1;
+    }
+    for (int i=0; i<56; i++) {
+        keys_zipped[i] = BS_ZERO;
+    }
+    for (int i=0; i<56-num_chunk_bits; i++) {
+        if (prefix[i] != '0' && prefix[i] != '1') {
+            return -1;
+        }
+        keys_zipped[i] = prefix[i] == '1' ? BS_ONES : BS_ZERO;
+    }
+
+    // Key bits 6 and up of a lane are the number of its 64 bit word
+    for (int word=0; word<BS_WORDS; word++) {
+        for (int i=6; i<BS_WIDTH_BITS; i++) {
+            bs_set_word(&keys_zipped[55-i], word, (word >> (i-6)) & 1 ? 0xffffffffffffffffLL : 0);
+        }
+        for (int i=0; i<6; i++) {
+            bs_set_word(&keys_zipped[50+i], word, low_bits[i]);
+        }
+    }
+    return 0;
+}
+
+// Zero based, so initial_permutation[i] is the input bit for output bit i
+static const unsigned char initial_permutation[64] = {
+    57, 49, 41, 33, 25, 17,  9, 1,
+    59, 51, 43, 35, 27, 19, 11, 3,
+    61, 53, 45, 37, 29, 21, 13, 5,
+    63, 55, 47, 39, 31, 23, 15, 7,
+    56, 48, 40, 32, 24, 16,  8, 0,
+    58, 50, 42, 34, 26, 18, 10, 2,
+    60, 52, 44, 36, 28, 20, 12, 4,
+    62, 54, 46, 38, 30, 22, 14, 6
+};
+
+/*
+ * Applies the initial permutation, optionally switches the halves, and
+ * spreads every bit across a whole word (the same value in all 64 lanes).
+ */
+static void preprocess_block(uint64_t block, int switch_halves, uint64_t zipped[64]) {
+    for (int i=0; i<64; i++) {
+        int bit = initial_permutation[switch_halves ? (i+32)%64 : i];
+        zipped[i] = (block >> (63-bit)) & 1 ? 0xffffffffffffffffLL : 0;
+    }
+}
+
+/*
+ * Preprocesses a plaintext-ciphertext pair the way set_input.py writes it
+ * into input.h, for plaintext_zipped and ciphertext_zipped of a key_search
+ * whose pair is only known at runtime.
+ */
+static void set_pair(uint64_t plaintext, uint64_t ciphertext, uint64_t plaintext_zipped[64], uint64_t ciphertext_zipped[64]) {
+    preprocess_block(plaintext, 1, plaintext_zipped);
+    preprocess_block(ciphertext, 0, ciphertext_zipped);
+}
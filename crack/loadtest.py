@@ -0,0 +1,391 @@
+"""
+Load tests lib/distproc.py's WorkManager with simulated workers.
+
+The manager runs in this process, unchanged except that its tasks are
+numbers and results are thrown away.  The workers are simulated by a few
+processes, each keeping many connections open with an event loop, so
+thousands of them can run on one machine.  A simulated worker handles tasks
+like worker.py: one at a time, in the order they're sent.  Instead of
+running check_keys it waits for as long as check_keys would take at the
+given keys per second, plus any per-task overhead.
+
+Each run searches the same number of keys, so runs with different
+NUM_CHUNK_BITS are comparable.  Efficiency is the time the workers would
+have needed with perfect scheduling, divided by the time they actually
+took.  Small chunks lose to dispatch latency and manager overhead, and
+large chunks lose to the tail at the end, where some workers are idle while
+the last tasks finish.
+
+"""
+
+import sys
+import heapq
+import random
+import os.path
+import resource
+from time import time
+from select import poll, POLLIN
+from collections import deque
+from multiprocessing import Process, Queue, Event, cpu_count
+from multiprocessing.connection import Client
+from optparse import OptionParser
+
+# Add lib/ to sys.path
+lib_directory = os.path.realpath(os.path.join(__file__, "../../lib/"))
+sys.path.append(lib_directory)
+
+from distproc import WorkManager
+
+# Seconds a simulated worker waits before connecting again after it drops
+RECONNECT_DELAY = 1.0
+
+# Seconds a simulated worker waits for its worker id before giving up on a
+# connection and trying again
+CONNECT_TIMEOUT = 10.0
+
+class LoadTestManager(WorkManager):
+
+    def __init__(self, num_tasks, num_workers, authkey=None, verbose=False):
+        self.num_tasks = num_tasks
+        self.num_workers = num_workers
+        self.verbose = verbose
+        self.start_time = time()
+        self.ramp_up = None  # Seconds until every worker was connected
+        super(LoadTestManager, self).__init__("127.0.0.1", 0, authkey)
+
+    @property
+    def address(self):
+        return self.listener.address
+
+    def tasks(self):
+        return xrange(self.num_tasks)
+
+    def total_work(self):
+        return self.num_tasks
+
+    def accept_new_clients(self):
+        super(LoadTestManager, self).accept_new_clients()
+        if self.ramp_up is None and len(self.worker_ids) >= self.num_workers:
+            self.ramp_up = time() - self.start_time
+
+    def process_result(self, worker_id, task_data, result):
+        pass
+
+    def log(self, *items, **kwargs):
+        if self.verbose:
+            super(LoadTestManager, self).log(*items, **kwargs)
+
+
+class SimulatedWorker(object):
+
+    def __init__(self, connection):
+        self.connection = connection
+        self.closed = False
+        self.busy = False
+        self.queue = deque()  # (time it arrives after the network delay, task)
+        self.sent = deque()  # When each result not yet answered was sent
+        self.unsent = 0  # Results still in the simulated network
+        self.initial_tasks = 2  # Sent on connect, not in reply to a result
+
+
+def simulate(addresses, finished, authkey, num_workers, settings, seed, results):
+    '''
+    Runs num_workers simulated workers until the manager runs out of tasks,
+    then puts (dispatch latencies, disconnects) on the results queue.
+
+    The manager's address comes from the addresses queue.  The process is
+    started before the manager exists, so it doesn't inherit the manager's
+    listening socket, which would keep connections to a finished manager
+    open with nobody on the other end.  The finished event is set once the
+    manager has exited, so workers waiting to reconnect don't try.
+    '''
+    address = addresses.get()
+    random.seed(seed)
+    task_seconds, jitter, overhead, latency, disconnect_rate = settings
+    poller = poll()
+    workers = {}  # Maps file descriptors to workers
+    events = []  # Heap of (time, sequence number, function, arguments)
+    sequence = [0]
+    to_connect = [num_workers]
+    latencies = []
+    disconnects = [0]
+
+    def schedule(when, function, *args):
+        sequence[0] += 1
+        heapq.heappush(events, (when, sequence[0], function, args))
+
+    def close(worker):
+        worker.closed = True
+        poller.unregister(worker.connection.fileno())
+        del workers[worker.connection.fileno()]
+        worker.connection.close()
+
+    def connect():
+        to_connect[0] -= 1
+        if finished.is_set():
+            to_connect[0] = 0
+            return
+        try:
+            connection = Client(address, authkey=authkey)
+            if not connection.poll(CONNECT_TIMEOUT):
+                connection.close()
+                schedule(time() + RECONNECT_DELAY, reconnect)
+                return
+            connection.recv()  # Worker id
+        except (IOError, EOFError):
+            # The manager has finished.  Client() retries a refused
+            # connection for 20 seconds, so don't try again.
+            to_connect[0] = 0
+            return
+        worker = SimulatedWorker(connection)
+        workers[connection.fileno()] = worker
+        poller.register(connection.fileno(), POLLIN)
+
+    def reconnect():
+        to_connect[0] += 1
+
+    def start(worker):
+        now = time()
+        if worker.closed or worker.busy or not worker.queue:
+            return
+        arrival, task = worker.queue[0]
+        if arrival > now:
+            schedule(arrival, start, worker)
+            return
+        if task is False:
+            # Out of tasks.  Like worker.py, exit once the last result is out.
+            if not worker.unsent:
+                close(worker)
+            return
+        worker.queue.popleft()
+        compute = (task_seconds + overhead) * random.uniform(1 - jitter, 1 + jitter)
+        worker.busy = True
+        schedule(now + compute, finish, worker, task, now - arrival, compute)
+
+    def finish(worker, task, queue_time, compute):
+        if worker.closed:
+            return
+        worker.busy = False
+        if random.random() < disconnect_rate:
+            disconnects[0] += 1
+            close(worker)
+            schedule(time() + RECONNECT_DELAY, reconnect)
+            return
+        worker.unsent += 1
+        schedule(time() + latency, send, worker, (task, None, (queue_time, compute)))
+        start(worker)
+
+    def send(worker, message):
+        if worker.closed:
+            return
+        worker.unsent -= 1
+        try:
+            worker.connection.send(message)
+        except IOError:
+            close(worker)
+            return
+        worker.sent.append(time())
+        start(worker)
+
+    def receive(worker):
+        try:
+            task = worker.connection.recv()
+        except (EOFError, IOError):
+            close(worker)
+            return
+        now = time()
+        if worker.initial_tasks:
+            worker.initial_tasks -= 1
+        else:
+            latencies.append(now - worker.sent.popleft())
+        worker.queue.append((now + latency, task))
+        start(worker)
+
+    while to_connect[0] or workers or events:
+
+        # Connect one worker at a time, so the ones already connected get
+        # going while the rest wait for the manager to accept them.
+        if to_connect[0]:
+            connect()
+
+        now = time()
+        while events and events[0][0] <= now:
+            when, n, function, args = heapq.heappop(events)
+            function(*args)
+
+        if to_connect[0]:
+            timeout = 0
+        elif events:
+            timeout = max(events[0][0] - time(), 0)
+        else:
+            timeout = 1.0
+        for fd, event in poller.poll(timeout * 1000):
+            if fd in workers:
+                receive(workers[fd])
+
+    results.put((latencies, disconnects[0]))
+
+def cpu_seconds(who):
+    usage = resource.getrusage(who)
+    return usage.ru_utime + usage.ru_stime
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    return values[min(int(len(values) * fraction), len(values) - 1)]
+
+def load_test(num_chunk_bits, options):
+    '''Runs one test and returns a dict of the results.'''
+
+    num_tasks = 2**(options.keyspace_bits - num_chunk_bits)
+    task_seconds = 2.0**num_chunk_bits / options.rate
+    settings = (task_seconds, options.jitter, options.overhead,
+                options.latency, options.disconnect_rate)
+
+    # The processes are started before the manager, so they don't inherit
+    # its listening socket.  They wait for its address on the queue.
+    addresses = Queue()
+    finished = Event()
+    results = Queue()
+    num_processes = min(options.processes, options.workers)
+    processes = []
+    for i in xrange(num_processes):
+        count = options.workers // num_processes + (i < options.workers % num_processes)
+        processes.append(Process(target=simulate, args=(
+            addresses, finished, options.secret, count, settings, random.random(), results)))
+    for process in processes:
+        process.start()
+
+    children_cpu = cpu_seconds(resource.RUSAGE_CHILDREN)
+    manager_cpu = cpu_seconds(resource.RUSAGE_SELF)
+    manager = LoadTestManager(num_tasks, options.workers, options.secret, options.verbose)
+    start = time()
+    for process in processes:
+        addresses.put(manager.address)
+    manager.run()
+    finished.set()
+    seconds = time() - start
+    manager_cpu = cpu_seconds(resource.RUSAGE_SELF) - manager_cpu
+
+    latencies = []
+    disconnects = 0
+    for process in processes:
+        process_latencies, process_disconnects = results.get()
+        latencies.extend(process_latencies)
+        disconnects += process_disconnects
+    for process in processes:
+        process.join()
+    children_cpu = cpu_seconds(resource.RUSAGE_CHILDREN) - children_cpu
+    latencies.sort()
+
+    ideal = num_tasks * task_seconds / options.workers
+    return {
+        "chunk_bits": num_chunk_bits,
+        "tasks": num_tasks,
+        "task_seconds": task_seconds,
+        "seconds": seconds,
+        "tasks_per_second": num_tasks / seconds,
+        "ramp_up": manager.ramp_up,
+        "latency_mean": sum(latencies) / len(latencies) if latencies else 0.0,
+        "latency_median": percentile(latencies, 0.5),
+        "latency_99": percentile(latencies, 0.99),
+        "manager_cpu": manager_cpu / seconds,
+        "workers_cpu": children_cpu / seconds,
+        "disconnects": disconnects,
+        "dropped": manager.metrics.dropped,
+        "efficiency": ideal / seconds,
+    }
+
+def print_result(r):
+    if r["ramp_up"] is not None:
+        ramp_up = "all workers connected after %.1fs" % r["ramp_up"]
+    else:
+        ramp_up = "workers ran out of tasks before all were connected"
+    print "NUM_CHUNK_BITS=%d: %d tasks of %.3fs" % (r["chunk_bits"], r["tasks"], r["task_seconds"])
+    print "  Time:             %.1fs, %s" % (r["seconds"], ramp_up)
+    print "  Tasks per second: %.1f" % r["tasks_per_second"]
+    print "  Dispatch latency: %.1fms mean, %.1fms median, %.1fms 99th percentile" % (
+        r["latency_mean"] * 1000, r["latency_median"] * 1000, r["latency_99"] * 1000)
+    print "  CPU:              manager %.0f%%, simulated workers %.0f%%" % (
+        r["manager_cpu"] * 100, r["workers_cpu"] * 100)
+    print "  Disconnects:      %d, %d tasks dropped" % (r["disconnects"], r["dropped"])
+    print "  Efficiency:       %.1f%%" % (r["efficiency"] * 100)
+
+def read_num_chunk_bits():
+    try:
+        from autotune import read_num_chunk_bits
+        return read_num_chunk_bits()
+    except (IOError, ValueError):
+        return 26
+
+if __name__ == "__main__":
+
+    op = OptionParser(
+        usage="%prog [options]",
+        description="Load tests the distproc WorkManager with simulated "
+        "workers, and reports dispatch latency, tasks per second, CPU usage "
+        "and efficiency for each NUM_CHUNK_BITS given.")
+    op.add_option("-w", "--workers", type="int", dest="workers", default=1000,
+        help="Number of simulated workers.  Default 1000.")
+    op.add_option("-p", "--processes", type="int", dest="processes",
+        default=cpu_count(), help="Processes to simulate the workers in.  "
+        "Default is the number of cores.")
+    op.add_option("-b", "--chunk-bits", type="string", dest="chunk_bits",
+        default=None, help="Comma separated NUM_CHUNK_BITS values to test.  "
+        "Default is the one in input.h.")
+    op.add_option("-k", "--keyspace-bits", type="int", dest="keyspace_bits",
+        default=40, help="Search 2^KEYSPACE_BITS keys in each test.  "
+        "Default 40.")
+    op.add_option("-r", "--rate", type="float", dest="rate", default=2**24,
+        help="Keys per second of each simulated worker.  Default 2^24.")
+    op.add_option("-o", "--overhead", type="float", dest="overhead", default=0.0,
+        help="Seconds each task takes on top of searching keys, like "
+        "starting check_keys.  Default 0.")
+    op.add_option("-j", "--jitter", type="float", dest="jitter", default=0.1,
+        help="Task times vary randomly by up to this fraction.  Default 0.1.")
+    op.add_option("-d", "--disconnect-rate", type="float", dest="disconnect_rate",
+        default=0.0, help="Chance that a worker disconnects instead of "
+        "returning a result.  It reconnects a second later.  Default 0.")
+    op.add_option("-l", "--latency", type="float", dest="latency", default=0.0,
+        help="Simulated network delay in seconds, each way.  Default 0.")
+    op.add_option("-s", "--secret", type="string", dest="secret", default=None,
+        help="Preshared secret, to include authentication in the test.")
+    op.add_option("-v", "--verbose", dest="verbose", action="store_true",
+        default=False, help="Print the manager's log.")
+    options, args = op.parse_args()
+    if args:
+        op.error("Too many arguments")
+    if options.workers < 1 or options.processes < 1:
+        op.error("--workers and --processes must be at least 1")
+    if options.rate <= 0:
+        op.error("--rate must be positive")
+    if not 0 <= options.jitter < 1:
+        op.error("--jitter must be at least 0 and less than 1")
+    if not 0 <= options.disconnect_rate < 1:
+        op.error("--disconnect-rate must be at least 0 and less than 1")
+    if options.overhead < 0 or options.latency < 0:
+        op.error("--overhead and --latency can't be negative")
+
+    os.chdir(os.path.dirname(os.path.realpath(__file__)))
+    if options.chunk_bits:
+        try:
+            chunk_bits = [int(b) for b in options.chunk_bits.split(",")]
+        except ValueError:
+            op.error("--chunk-bits must be a comma separated list of numbers")
+    else:
+        chunk_bits = [read_num_chunk_bits()]
+    for b in chunk_bits:
+        if not 0 < b <= options.keyspace_bits:
+            op.error("NUM_CHUNK_BITS must be between 1 and --keyspace-bits")
+
+    # Each worker uses a file descriptor on both ends
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    wanted = 2 * options.workers + 64
+    if soft != resource.RLIM_INFINITY and soft < wanted:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(wanted, hard), hard))
+
+    print "%d workers at %.0f keys/second, 2^%d keys per test" % (
+        options.workers, options.rate, options.keyspace_bits)
+    for b in chunk_bits:
+        print_result(load_test(b, options))
+        sys.stdout.flush()
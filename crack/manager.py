@@ -1,17 +1,23 @@
 
 import sys
 import re
+import random
 import os.path
 from time import time
-from itertools import imap
 from optparse import OptionParser
 
 # Add lib/ to sys.path
 lib_directory = os.path.realpath(os.path.join(__file__, "../../lib/"))
 sys.path.append(lib_directory)
 
+# And the repository root, for des.py
+sys.path.append(os.path.realpath(os.path.join(__file__, "../../")))
+
 from distproc import WorkManager
 import bittools
+import des
+from shard import Journal, job_search_id, input_search_id, input_search_prefix, \
+    get_complement_mode, task_prefix, task_string, keys_from_output
 
 def count_inf(start=0, step=1):
     '''Generator yielding start+n*step for n=0,1,2,...'''
@@ -26,30 +32,359 @@ def get_num_chunk_bits():
     match = re.search("#define NUM_CHUNK_BITS (\d{1,2})", input_file)
     return int(match.group(1))
 
+def get_input_pair():
+    '''
+    The plaintext and ciphertext in input.h, in hex, if it's a single known
+    plaintext pair, which a "plaintext:ciphertext:prefix" task searches the
+    same way.  None in complement mode, with extra pairs or ciphertext only.
+    '''
+    with open("input.h") as f:
+        input_file = f.read()
+    if re.search("#define (COMPLEMENT_MODE|NUM_EXTRA_PAIRS|CIPHERTEXT_ONLY_MODE)", input_file):
+        return None
+    plaintext = re.search("// Unprocessed plaintext: 0x([0-9a-fA-F]{16})", input_file)
+    ciphertext = re.search("// Unprocessed ciphertext: 0x([0-9a-fA-F]{16})", input_file)
+    if not plaintext or not ciphertext:
+        return None
+    return plaintext.group(1).lower(), ciphertext.group(1).lower()
+
+def encrypt_block(plaintext, key):
+    '''Encrypts a 16 hex digit block with a 56 bit key, in hex.'''
+    des.print_logs = False
+    key_bits = des.get_key("%014x" % key)
+    return bittools.bits_to_hex(des.dsa_encrypt(bittools.hex_to_bits(plaintext), key_bits))
+
+def parse_job(spec):
+    '''
+    Parses "PLAINTEXT:CIPHERTEXT[:PREFIX[:WEIGHT]]" into (plaintext,
+    ciphertext, prefix, weight).  Raises ValueError if it's invalid.
+    '''
+    fields = spec.strip().split(":")
+    if len(fields) < 2 or len(fields) > 4:
+        raise ValueError("Job must be PLAINTEXT:CIPHERTEXT[:PREFIX[:WEIGHT]]: '%s'" % spec)
+    plaintext, ciphertext = fields[0].lower(), fields[1].lower()
+    prefix = fields[2] if len(fields) > 2 else ""
+    weight = float(fields[3]) if len(fields) > 3 else 1.0
+    for block in (plaintext, ciphertext):
+        if not re.match("^[0-9a-f]{16}$", block):
+            raise ValueError("Plaintext and ciphertext must be 16 hex digits: '%s'" % block)
+    if not re.match("^[01]*$", prefix):
+        raise ValueError("Prefix must be binary: '%s'" % prefix)
+    if weight <= 0:
+        raise ValueError("Weight must be positive: '%s'" % spec)
+    return plaintext, ciphertext, prefix, weight
+
+class Job(object):
+    '''
+    One search in a manager running several: a pair, a key prefix and a
+    weight.  Tasks are "plaintext:ciphertext:prefix", which workers search
+    without input.h's pair, so they can switch between jobs freely.
+    '''
+
+    def __init__(self, number, plaintext, ciphertext, prefix, weight, num_chunk_bits):
+        self.number = number
+        self.plaintext = plaintext
+        self.ciphertext = ciphertext
+        self.prefix = prefix
+        self.weight = weight
+        self.search_id = job_search_id(plaintext, ciphertext, prefix)
+        self.task_bits = 56 - num_chunk_bits - len(prefix)
+        self.num_tasks = 2**self.task_bits
+        self.tasks_enumerated = 0
+        self.tasks_finished = 0
+        self.results = []
+
+        # Tasks handed out divided by weight.  The job with the least goes
+        # next, so each job gets tasks in proportion to its weight.
+        self.virtual_time = 0.0
+
+    def __str__(self):
+        return "Job %d" % self.number
+
+    def all_enumerated(self):
+        return self.tasks_enumerated == self.num_tasks
+
+    def done(self, journal=None):
+        if journal:
+            return journal.num_done(self.search_id) == self.num_tasks
+        return self.tasks_finished == self.num_tasks
+
+    def total_work(self, num_chunk_bits, journal=None):
+        num_done = journal.num_done(self.search_id) if journal else 0
+        return (self.num_tasks - num_done) * 2**num_chunk_bits
+
+    def next_task(self, journal=None):
+        '''
+        The next task, skipping any that the journal has as done or out in a
+        shard.  None if there are no more.
+        '''
+        index = self.tasks_enumerated
+        if journal:
+            index = min(journal.next_free(self.search_id, index), self.num_tasks)
+        if index == self.num_tasks:
+            self.tasks_enumerated = index
+            return None
+        self.tasks_enumerated = index + 1
+        self.virtual_time += 1.0 / self.weight
+        return task_string(self.search_id, self.task_bits, index)
+
 class DesWorkManager(WorkManager):
 
+    work_unit_name = "keys"
+
     def __init__(self, *args, **kwargs):
 
         self.results = []
         self.prefix = kwargs.pop("prefix", "")
-        self.num_chunk_bits = get_num_chunk_bits()
+        self.num_chunk_bits = kwargs.pop("num_chunk_bits", None) or get_num_chunk_bits()
+        self.complement_mode = get_complement_mode()
         self.start_time = time()
 
+        # Progress shared with shard.py, so tasks done offline are skipped
+        journal_file = kwargs.pop("journal", None)
+        self.journal = Journal(journal_file) if journal_file else None
+        self.found_keys = set()  # (search_id, key) already logged
+
+        # Jobs, if any, replace the single search of input.h's pair
+        job_specs = kwargs.pop("jobs", [])
+        self.jobs_file = kwargs.pop("jobs_file", None)
+        self.jobs_file_lines = 0
+        self.jobs_file_stat = None
+        self.jobs = None
+        if job_specs or self.jobs_file:
+            self.jobs = []
+            self.complement_mode = False
+            for spec in job_specs:
+                self.add_job(*parse_job(spec))
+            self.read_jobs_file()
+
+        # In complement mode, the prefix defaults to "0".  shard.py uses the
+        # same rule, so both journal under the same search id.
+        if self.jobs is None:
+            self.prefix = input_search_prefix(self.prefix)
+        self.search_id = input_search_id(self.prefix) if self.jobs is None else None
+        self.task_bits = 56 - self.num_chunk_bits - len(self.prefix)
+
+        # With spot checks, tasks for input.h's pair are sent like decoys, as
+        # "plaintext:ciphertext:prefix", if the pair can be searched that way
+        self.input_pair = None
+        if self.jobs is None and kwargs.get("spot_check_rate"):
+            self.input_pair = get_input_pair()
+
         super(DesWorkManager, self).__init__(*args, **kwargs)
+        self.check_journal()
+        if self.jobs is None and self.spot_check_rate and not self.input_pair:
+            self.log("input.h isn't a single known plaintext pair, so tasks are "
+                     "bare prefixes, which workers can tell apart from decoys.")
+
+    def add_job(self, plaintext, ciphertext, prefix, weight):
+
+        # Start even with the jobs already running, so a new job shares from
+        # now on instead of catching up on what it missed.
+        running = [job for job in self.jobs if not job.all_enumerated()]
+        job = Job(len(self.jobs) + 1, plaintext, ciphertext, prefix, weight, self.num_chunk_bits)
+        job.virtual_time = min(j.virtual_time for j in running) if running else 0.0
+        self.jobs.append(job)
+
+        if hasattr(self, "metrics") and self.metrics.remaining_work is not None:
+            self.metrics.remaining_work += job.total_work(self.num_chunk_bits, self.journal)
+        self.log("%s added: %s:%s, prefix '%s', weight %g, %d tasks" %
+                 (job, plaintext, ciphertext, prefix, weight, job.num_tasks))
+
+    def read_jobs_file(self):
+        '''Adds jobs appended to the jobs file since it was last read.'''
+        if not self.jobs_file:
+            return
+        try:
+            stat = os.stat(self.jobs_file)
+        except OSError:
+            return
+        if (stat.st_mtime, stat.st_size) == self.jobs_file_stat:
+            return
+        self.jobs_file_stat = (stat.st_mtime, stat.st_size)
+
+        with open(self.jobs_file) as f:
+            lines = f.readlines()
+        for line in lines[self.jobs_file_lines:]:
+            if not line.endswith("\n"):
+                break  # Still being written
+            self.jobs_file_lines += 1
+            line = line.split("#")[0].strip()
+            if not line:
+                continue
+            try:
+                self.add_job(*parse_job(line))
+            except ValueError as e:
+                self.log("Skipping job in %s: %s" % (self.jobs_file, e))
+
+    def job_tasks_fair_share(self):
+        '''
+        Interleaves the tasks of every job by weighted fair share.  A task is
+        only picked when a worker needs one, so a new or heavier job takes
+        over at the next task boundary.
+        '''
+        while True:
+            self.read_jobs_file()
+            self.check_journal()
+            running = [job for job in self.jobs if not job.all_enumerated()]
+            if not running:
+                return
+            job = min(running, key=lambda job: (job.virtual_time, job.number))
+            task = job.next_task(self.journal)
+            if task is not None:
+                yield task
 
     def tasks(self):
 
-        int_to_bin = lambda x: bin(x)[2:].rjust(56-self.num_chunk_bits-len(self.prefix), '0')
-        for task in imap(int_to_bin, range(0, 2**(56-self.num_chunk_bits-len(self.prefix)))):
-            yield self.prefix + task
+        if self.jobs is not None:
+            for task in self.job_tasks_fair_share():
+                yield task
+            return
+
+        index = 0
+        while index < 2**self.task_bits:
+            if self.journal:
+                self.check_journal()
+                index = self.journal.next_free(self.search_id, index)
+                if index >= 2**self.task_bits:
+                    return
+            prefix = task_prefix(self.prefix, self.task_bits, index)
+            if self.input_pair:
+                yield "%s:%s:%s" % (self.input_pair + (prefix,))
+            else:
+                yield prefix
+            index += 1
+
+    def check_journal(self):
+        '''Logs keys that shard.py imported into the journal.'''
+        if not self.journal:
+            return
+        self.journal.refresh()
+        for search_id, key in self.journal.pop_new_keys():
+            if (search_id, key) in self.found_keys:
+                continue
+            self.found_keys.add((search_id, key))
+            self.log("Found match in the journal (%s): %s" % (search_id, key))
+            if self.jobs is None:
+                if search_id == self.search_id:
+                    self.results.append(key)
+            else:
+                for job in self.jobs:
+                    if job.search_id == search_id:
+                        job.results.append(key)
+
+    def record_in_journal(self, search_id, task, result):
+        '''Records a finished task, "[plaintext:ciphertext:]prefix".'''
+        if not self.journal:
+            return
+        keys = keys_from_output(result or "")
+        self.found_keys.update((search_id, key) for key in keys)
+        self.journal.record_done(search_id, self.task_index(search_id, task), 1, keys)
+
+    def task_index(self, search_id, task):
+        suffix = task.split(":")[-1][56 - self.num_chunk_bits - self.task_bits_of(search_id):]
+        return int(suffix, 2) if suffix else 0
+
+    def job_of(self, task_data):
+        '''
+        The job a "plaintext:ciphertext:prefix" task belongs to.  Found from
+        the task itself rather than remembered, since spot checks can hand
+        a finished task out again.  Jobs with the same pair and overlapping
+        prefixes make the same tasks, so the longest prefix wins.
+        '''
+        plaintext, ciphertext, key_prefix = task_data.split(":")
+        matching = [job for job in self.jobs
+                    if (job.plaintext, job.ciphertext) == (plaintext, ciphertext) and
+                    key_prefix.startswith(job.prefix)]
+        return max(matching, key=lambda job: len(job.prefix))
+
+    def task_bits_of(self, search_id):
+        if self.jobs is None:
+            return self.task_bits
+        for job in self.jobs:
+            if job.search_id == search_id:
+                return job.task_bits
+
+    def make_decoy(self):
+        '''
+        A random chunk of a job's keyspace, or of the prefix's in input.h
+        mode, with a pair made from a random key in it.  Decoys are always
+        "plaintext:ciphertext:prefix" tasks, since input.h's pair can't be
+        made to match a known key.  They use the real plaintext, so only the
+        ciphertext differs from real tasks.
+        '''
+        if self.jobs:
+            running = [job for job in self.jobs if not job.all_enumerated()] or self.jobs
+            job = random.choice(running)
+            plaintext, prefix = job.plaintext, job.prefix
+        elif self.input_pair:
+            plaintext, prefix = self.input_pair[0], self.prefix
+        else:
+            plaintext, prefix = "%016x" % random.getrandbits(64), self.prefix
+        task_bits = 56 - self.num_chunk_bits - len(prefix)
+        chunk = task_prefix(prefix, task_bits, random.randrange(2**task_bits))
+        key = int(chunk or "0", 2) << self.num_chunk_bits | random.randrange(2**self.num_chunk_bits)
+        task = "%s:%s:%s" % (plaintext, encrypt_block(plaintext, key), chunk)
+        return task, "0x%014x" % key
+
+    def decoy_passed(self, expected, result):
+        return expected in keys_from_output(result or "")
+
+    def unfinish(self, task_data):
+        if self.jobs is not None:
+            job = self.job_of(task_data)
+            job.tasks_finished -= 1
+            search_id = job.search_id
+        else:
+            search_id = self.search_id
+        if self.journal:
+            self.journal.record_redo(search_id, self.task_index(search_id, task_data), 1)
+
+    def work_units(self, task_data):
+        if self.jobs is not None:
+            return 2**self.num_chunk_bits
+        if self.complement_mode:
+            return 2**(self.num_chunk_bits+1)
+        return 2**self.num_chunk_bits
+
+    def total_work(self):
+        if self.jobs is not None:
+            return sum(job.total_work(self.num_chunk_bits, self.journal) for job in self.jobs)
+        num_done = self.journal.num_done(self.search_id) if self.journal else 0
+        return (2**self.task_bits - num_done) * self.work_units(None)
 
     def process_result(self, worker_id, task_data, result):
+        if self.jobs is not None:
+            self.process_job_result(worker_id, task_data, result)
+        else:
+            self.record_in_journal(self.search_id, task_data, result)
+            if result:
+                self.results.append(result)
+                self.log("==Worker %s== Found match in %.2f seconds: %s" % (worker_id, time()-self.start_time, result))
+
+    def process_job_result(self, worker_id, task_data, result):
+        job = self.job_of(task_data)
+        job.tasks_finished += 1
+        self.record_in_journal(job.search_id, task_data, result)
         if result:
-            self.results.append(result)
-            self.log("==Worker %s== Found match in %.2f seconds: %s" % (worker_id, time()-self.start_time, result))
+            job.results.append(result)
+            self.log("==Worker %s== %s found match in %.2f seconds: %s" % (worker_id, job, time()-self.start_time, result))
+        if job.done(self.journal):
+            self.log("%s finished in %.2f seconds.  Results: %s" % (job, time()-self.start_time, job.results))
 
     def finish(self):
-        self.log("Results:", self.results)
+        if self.jobs is not None:
+            for job in self.jobs:
+                finished = self.journal.num_done(job.search_id) if self.journal else job.tasks_finished
+                self.log("%s (%s:%s, prefix '%s'): %d of %d tasks.  Results: %s" %
+                         (job, job.plaintext, job.ciphertext, job.prefix,
+                          finished, job.num_tasks, job.results))
+        else:
+            self.log("Results:", self.results)
+        if self.journal:
+            self.check_journal()
+            for shard_id, (search_id, first, count) in sorted(self.journal.exports.items()):
+                self.log("Shard %s (%s) still out: tasks %d to %d" % (shard_id, search_id, first, first + count - 1))
 
 if __name__ == "__main__":
 
@@ -61,6 +396,33 @@ if __name__ == "__main__":
         help="Preshared secret that workers must use to authenticate.")
     op.add_option("-p", "--prefix", type="string", dest="prefix", default="",
         help="If you know the first part of the key, specify it here in binary.")
+    op.add_option("-j", "--job", type="string", dest="jobs", action="append", default=[],
+        help="Search for another pair instead of the one in input.h, as "
+        "PLAINTEXT:CIPHERTEXT[:PREFIX[:WEIGHT]] in hex, with an optional "
+        "binary key prefix.  Can be given more than once.  Jobs share the "
+        "workers in proportion to their weight (default 1).")
+    op.add_option("-J", "--jobs-file", type="string", dest="jobs_file", default=None,
+        help="Read jobs from this file, one per line like --job.  Lines "
+        "appended while the manager is running are added as new jobs.")
+    op.add_option("--journal", type="string", dest="journal", default=None,
+        help="Record finished tasks in this file, and skip tasks it already "
+        "has as finished or exported to a shard.  Shared with shard.py, "
+        "which exports tasks for machines that can't connect and imports "
+        "their results.")
+    op.add_option("-m", "--metrics", type="string", dest="metrics", default=None,
+        help="Serve throughput and latency metrics over HTTP in the Prometheus "
+        "text format on [address:]port.  Address defaults to localhost.")
+    op.add_option("-c", "--chunk-bits", type="int", dest="chunk_bits", default=None,
+        help="Make each task 2^CHUNK_BITS keys instead of input.h's "
+        "NUM_CHUNK_BITS.  For workers that connect through relay.py, which "
+        "splits tasks into its own input.h's chunks.")
+    op.add_option("--spot-check", type="float", dest="spot_check", default=0.0,
+        help="Send this fraction of tasks, such as 0.02, as decoys with a "
+        "known key.  A worker that misses one is disconnected, and every task "
+        "it finished since its last passed decoy is searched again, as it is "
+        "if it disconnects with one outstanding.  This catches broken or lazy "
+        "workers, not ones written to spot decoys: their ciphertext isn't "
+        "the real one.")
 
     options, args = op.parse_args()
     if len(args) > 1:
@@ -80,10 +442,41 @@ if __name__ == "__main__":
     if not port:
         op.error("Invalid port number")
 
+    # Validate jobs
+    if (options.jobs or options.jobs_file) and options.prefix:
+        op.error("--prefix can't be used with jobs.  Give each job its own prefix.")
+    for spec in options.jobs:
+        try:
+            parse_job(spec)
+        except ValueError as e:
+            op.error(str(e))
+
+    if options.chunk_bits is not None:
+        if not 6 <= options.chunk_bits <= 56 - len(options.prefix):
+            op.error("--chunk-bits must be between 6 and 56 minus the prefix length")
+        if options.journal:
+            op.error("--chunk-bits can't be used with --journal, which counts tasks of input.h's NUM_CHUNK_BITS")
+
+    if not 0 <= options.spot_check < 1:
+        op.error("--spot-check must be at least 0 and less than 1")
+
     # Validate prefix
     for char in options.prefix:
         if char not in '01':
             op.error("Invalid character in prefix: '%s'.  Prefix must be specified in binary, so all characters must be '0' or '1'." % char)
 
-    w = DesWorkManager(address, port, options.secret, prefix=options.prefix)
+    # Parse metrics address, port
+    metrics_address = None
+    if options.metrics:
+        match = re.match("^((.*):)?(\d+)$", options.metrics)
+        if match is None:
+            op.error("Metrics address must be in the format [address:]port")
+        metrics_address = (match.group(2) or '127.0.0.1', int(match.group(3)))
+
+    w = DesWorkManager(address, port, options.secret, prefix=options.prefix,
+                       jobs=options.jobs, jobs_file=options.jobs_file,
+                       journal=options.journal,
+                       num_chunk_bits=options.chunk_bits,
+                       metrics_address=metrics_address,
+                       spot_check_rate=options.spot_check)
     w.run()
@@ -0,0 +1,142 @@
+/*
+ * MD5 and HMAC-MD5, as described in RFC 1321 and RFC 2104.
+ *
+ * Only used by native_worker to answer the authentication challenge of
+ * Python's multiprocessing.connection, which uses HMAC-MD5.  This is not
+ * meant to be fast.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+struct md5_context {
+    uint32_t state[4];
+    uint64_t length;  // Bytes hashed so far
+    unsigned char buffer[64];
+};
+
+static const uint32_t md5_sines[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const unsigned char md5_shifts[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void md5_block(struct md5_context* ctx, const unsigned char block[64]) {
+    uint32_t m[16];
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+
+    for (int i=0; i<16; i++) {
+        m[i] = (uint32_t) block[i*4] | (uint32_t) block[i*4+1] << 8 |
+               (uint32_t) block[i*4+2] << 16 | (uint32_t) block[i*4+3] << 24;
+    }
+
+    for (int i=0; i<64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5*i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3*i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7*i) % 16;
+        }
+        f += a + md5_sines[i] + m[g];
+        a = d;
+        d = c;
+        c = b;
+        b += (f << md5_shifts[i]) | (f >> (32 - md5_shifts[i]));
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+}
+
+static void md5_init(struct md5_context* ctx) {
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+}
+
+static void md5_update(struct md5_context* ctx, const unsigned char* data, size_t length) {
+    for (size_t i=0; i<length; i++) {
+        ctx->buffer[ctx->length % 64] = data[i];
+        ctx->length++;
+        if (ctx->length % 64 == 0) {
+            md5_block(ctx, ctx->buffer);
+        }
+    }
+}
+
+static void md5_final(struct md5_context* ctx, unsigned char digest[16]) {
+    static const unsigned char padding[64] = {0x80};
+    unsigned char length_bytes[8];
+    uint64_t bit_length = ctx->length * 8;
+
+    for (int i=0; i<8; i++) {
+        length_bytes[i] = bit_length >> (i*8);
+    }
+    md5_update(ctx, padding, 1 + (119 - ctx->length % 64) % 64);
+    md5_update(ctx, length_bytes, 8);
+
+    for (int i=0; i<16; i++) {
+        digest[i] = ctx->state[i/4] >> (i%4 * 8);
+    }
+}
+
+static void hmac_md5(const unsigned char* key, size_t key_length,
+                     const unsigned char* message, size_t message_length,
+                     unsigned char digest[16]) {
+    struct md5_context ctx;
+    unsigned char key_block[64] = {0};
+    unsigned char pad[64];
+
+    // Keys longer than the block size are hashed first
+    if (key_length > 64) {
+        md5_init(&ctx);
+        md5_update(&ctx, key, key_length);
+        md5_final(&ctx, key_block);
+    } else {
+        memcpy(key_block, key, key_length);
+    }
+
+    // Inner hash
+    for (int i=0; i<64; i++) {
+        pad[i] = key_block[i] ^ 0x36;
+    }
+    md5_init(&ctx);
+    md5_update(&ctx, pad, 64);
+    md5_update(&ctx, message, message_length);
+    md5_final(&ctx, digest);
+
+    // Outer hash
+    for (int i=0; i<64; i++) {
+        pad[i] = key_block[i] ^ 0x5c;
+    }
+    md5_init(&ctx);
+    md5_update(&ctx, pad, 64);
+    md5_update(&ctx, digest, 16);
+    md5_final(&ctx, digest);
+}
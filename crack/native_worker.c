@@ -0,0 +1,700 @@
+/*
+ * A worker for manager.py written in C.
+ *
+ * worker.py runs one Python process per worker, each of which starts
+ * ./check_keys for every task and parses its output.  native_worker instead
+ * links the check_keys kernel directly (see check_keys.h), runs one thread
+ * per core and keeps a queue of prefetched tasks so no thread ever waits on
+ * the manager.
+ *
+ * To the manager, native_worker looks like a single worker.  It speaks the
+ * same protocol as lib/distproc.py's Worker, which is Python's
+ * multiprocessing.connection: each message is a 4 byte big endian length
+ * followed by a pickled object.  Only the handful of pickle opcodes the
+ * manager actually sends are understood.
+ *
+ * Tasks are a key prefix for the pair in input.h, or
+ * "plaintext:ciphertext:prefix" when the manager is running several jobs.
+ * The pair is then set at runtime (see set_pair in check_keys.h), so one
+ * build serves every job.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "check_keys.h"
+#include "md5.h"
+
+// Define plaintext_zipped, ciphertext_zipped, and NUM_CHUNK_BITS, the
+// extra_*_zipped arrays and NUM_EXTRA_PAIRS for more known pairs,
+// complement_zipped and COMPLEMENT_MODE for a complementary pair, or
+// predicate and CIPHERTEXT_ONLY_MODE when only ciphertext is known.  Uses
+// struct plaintext_predicate, so it must come after check_keys.h.
+#include "input.h"
+
+#if NUM_CHUNK_BITS < BS_WIDTH_BITS
+#error "NUM_CHUNK_BITS must be at least log2(BS_WIDTH)"
+#endif
+
+#define MAX_MESSAGE_SIZE (1<<20)
+#define MAX_PREFIX_SIZE 57
+
+// "plaintext:ciphertext:prefix"
+#define MAX_TASK_SIZE (16 + 1 + 16 + 1 + MAX_PREFIX_SIZE)
+
+static const char CHALLENGE[] = "#CHALLENGE#";
+static const char WELCOME[] = "#WELCOME#";
+static const char FAILURE[] = "#FAILURE#";
+
+// Values an unpickled message can have
+enum message_type {
+    MESSAGE_STRING,
+    MESSAGE_INT,
+    MESSAGE_FALSE,
+    MESSAGE_OTHER
+};
+
+struct message {
+    enum message_type type;
+    long integer;
+    char string[MAX_TASK_SIZE];
+};
+
+// Tasks received from the manager, but not yet started
+struct task_queue {
+    char (*tasks)[MAX_TASK_SIZE];
+    double* arrival_times;
+    int size;
+    int start;
+    int count;
+    int done;  // Set when the manager has no more tasks
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+static int manager_fd;
+static long worker_id;
+static struct task_queue queue;
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/***** Connection *****/
+
+static int send_all(const void* data, size_t length) {
+    const char* ptr = data;
+    while (length) {
+        ssize_t sent = send(manager_fd, ptr, length, 0);
+        if (sent <= 0) {
+            return -1;
+        }
+        ptr += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+static int recv_all(void* data, size_t length) {
+    char* ptr = data;
+    while (length) {
+        ssize_t received = recv(manager_fd, ptr, length, 0);
+        if (received <= 0) {
+            return -1;
+        }
+        ptr += received;
+        length -= received;
+    }
+    return 0;
+}
+
+static int send_bytes(const void* data, uint32_t length) {
+    unsigned char header[4] = {length >> 24, length >> 16, length >> 8, length};
+    if (send_all(header, 4)) {
+        return -1;
+    }
+    return send_all(data, length);
+}
+
+/*
+ * Receives one message into buffer, which must be MAX_MESSAGE_SIZE bytes.
+ * Returns the message length, or -1 on error or disconnect.
+ */
+static long recv_bytes(unsigned char* buffer) {
+    unsigned char header[4];
+    if (recv_all(header, 4)) {
+        return -1;
+    }
+    uint32_t length = (uint32_t) header[0] << 24 | (uint32_t) header[1] << 16 |
+                      (uint32_t) header[2] << 8 | header[3];
+    if (length > MAX_MESSAGE_SIZE || recv_all(buffer, length)) {
+        return -1;
+    }
+    return length;
+}
+
+static int connect_to_manager(const char* address, const char* port) {
+    struct addrinfo hints, *results, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(address, port, &hints, &results)) {
+        return -1;
+    }
+    int fd = -1;
+    for (result=results; result; result=result->ai_next) {
+        fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, result->ai_addr, result->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(results);
+    return fd;
+}
+
+/*
+ * Mutual authentication, the same as multiprocessing.connection.Client does
+ * it: answer the manager's challenge, then challenge the manager.
+ */
+static int authenticate(const char* secret) {
+    static unsigned char buffer[MAX_MESSAGE_SIZE];
+    unsigned char digest[16];
+    unsigned char challenge[20];
+    size_t challenge_length = strlen(CHALLENGE);
+
+    // Answer challenge
+    long length = recv_bytes(buffer);
+    if (length < (long) challenge_length || memcmp(buffer, CHALLENGE, challenge_length)) {
+        return -1;
+    }
+    hmac_md5((const unsigned char*) secret, strlen(secret),
+             buffer + challenge_length, length - challenge_length, digest);
+    if (send_bytes(digest, 16)) {
+        return -1;
+    }
+    length = recv_bytes(buffer);
+    if (length != (long) strlen(WELCOME) || memcmp(buffer, WELCOME, length)) {
+        return -1;
+    }
+
+    // Deliver challenge
+    FILE* urandom = fopen("/dev/urandom", "rb");
+    if (!urandom || fread(challenge, 1, 20, urandom) != 20) {
+        return -1;
+    }
+    fclose(urandom);
+    memcpy(buffer, CHALLENGE, challenge_length);
+    memcpy(buffer + challenge_length, challenge, 20);
+    if (send_bytes(buffer, challenge_length + 20)) {
+        return -1;
+    }
+    hmac_md5((const unsigned char*) secret, strlen(secret), challenge, 20, digest);
+    length = recv_bytes(buffer);
+    if (length != 16 || memcmp(buffer, digest, 16)) {
+        send_bytes(FAILURE, strlen(FAILURE));
+        return -1;
+    }
+    return send_bytes(WELCOME, strlen(WELCOME));
+}
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/***** Pickle *****/
+
+/*
+ * Decodes a pickled int, str or False.  Memo opcodes are skipped, and
+ * anything else gives MESSAGE_OTHER.
+ */
+static void unpickle(const unsigned char* data, long length, struct message* message) {
+    long i = 0;
+    message->type = MESSAGE_OTHER;
+
+    #define NEED(n) if (i + (n) > length) { message->type = MESSAGE_OTHER; return; }
+    while (i < length) {
+        unsigned char opcode = data[i++];
+        long size;
+        switch (opcode) {
+            case 0x80:  // PROTO
+                NEED(1);
+                i += 1;
+                break;
+            case 'q':  // BINPUT
+                NEED(1);
+                i += 1;
+                break;
+            case 'r':  // LONG_BINPUT
+                NEED(4);
+                i += 4;
+                break;
+            case 'K':  // BININT1
+                NEED(1);
+                message->type = MESSAGE_INT;
+                message->integer = data[i];
+                i += 1;
+                break;
+            case 'M':  // BININT2
+                NEED(2);
+                message->type = MESSAGE_INT;
+                message->integer = data[i] | data[i+1] << 8;
+                i += 2;
+                break;
+            case 'J':  // BININT
+                NEED(4);
+                message->type = MESSAGE_INT;
+                message->integer = (int32_t) ((uint32_t) data[i] | (uint32_t) data[i+1] << 8 |
+                                   (uint32_t) data[i+2] << 16 | (uint32_t) data[i+3] << 24);
+                i += 4;
+                break;
+            case 0x89:  // NEWFALSE
+                message->type = MESSAGE_FALSE;
+                break;
+            case 'U':  // SHORT_BINSTRING
+            case 'T':  // BINSTRING
+                if (opcode == 'U') {
+                    NEED(1);
+                    size = data[i];
+                    i += 1;
+                } else {
+                    NEED(4);
+                    size = data[i] | data[i+1] << 8 | data[i+2] << 16 | (long) data[i+3] << 24;
+                    i += 4;
+                }
+                NEED(size);
+                if (size >= MAX_TASK_SIZE) {
+                    message->type = MESSAGE_OTHER;
+                    return;
+                }
+                message->type = MESSAGE_STRING;
+                memcpy(message->string, &data[i], size);
+                message->string[size] = '\0';
+                i += size;
+                break;
+            case '.':  // STOP
+                return;
+            default:
+                message->type = MESSAGE_OTHER;
+                return;
+        }
+    }
+    #undef NEED
+}
+
+static unsigned char* pickle_string(unsigned char* out, const char* string, size_t length) {
+    if (length < 256) {
+        *out++ = 'U';
+        *out++ = length;
+    } else {
+        *out++ = 'T';
+        for (int i=0; i<4; i++) {
+            *out++ = length >> (i*8);
+        }
+    }
+    memcpy(out, string, length);
+    return out + length;
+}
+
+static unsigned char* pickle_float(unsigned char* out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    *out++ = 'G';  // BINFLOAT
+    for (int i=7; i>=0; i--) {
+        *out++ = bits >> (i*8);
+    }
+    return out;
+}
+
+/*
+ * Sends (task, result, (queue_seconds, compute_seconds)) back to the
+ * manager.  result is what check_keys would have printed.
+ */
+static int send_result(const char* task, const char* result, size_t result_length,
+                       double queue_seconds, double compute_seconds) {
+    size_t task_length = strlen(task);
+    unsigned char* message = malloc(task_length + result_length + 40);
+    unsigned char* out = message;
+    *out++ = 0x80;  // PROTO 2
+    *out++ = 2;
+    out = pickle_string(out, task, task_length);
+    out = pickle_string(out, result, result_length);
+    out = pickle_float(out, queue_seconds);
+    out = pickle_float(out, compute_seconds);
+    *out++ = 0x86;  // TUPLE2
+    *out++ = 0x87;  // TUPLE3
+    *out++ = '.';   // STOP
+
+    pthread_mutex_lock(&send_lock);
+    int error = send_bytes(message, out - message);
+    pthread_mutex_unlock(&send_lock);
+    free(message);
+    return error;
+}
+
+/*
+ * Asks the manager for one more task than it would otherwise send.  The
+ * manager sends two tasks when a worker connects, then one more for every
+ * result, so this is how the queue grows beyond two tasks.
+ */
+static int request_task() {
+    static const unsigned char none[] = {0x80, 2, 'N', '.'};
+    pthread_mutex_lock(&send_lock);
+    int error = send_bytes(none, sizeof(none));
+    pthread_mutex_unlock(&send_lock);
+    return error;
+}
+
+
+/***** Task Queue *****/
+
+/*
+ * Adds a task from the manager.  The manager only sends a task for a result
+ * or a request, so the queue can't fill up unless it breaks that protocol.
+ * If it does, exit rather than drop the task: the manager sees the
+ * connection close and hands out every task this worker had again.
+ */
+static void queue_push(const char* task) {
+    pthread_mutex_lock(&queue.lock);
+    if (queue.count >= queue.size) {
+        fprintf(stderr, "Manager sent more tasks than requested\n");
+        exit(1);
+    }
+    strcpy(queue.tasks[(queue.start + queue.count) % queue.size], task);
+    queue.arrival_times[(queue.start + queue.count) % queue.size] = now();
+    queue.count++;
+    pthread_cond_signal(&queue.changed);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+static void queue_finish() {
+    pthread_mutex_lock(&queue.lock);
+    queue.done = 1;
+    pthread_cond_broadcast(&queue.changed);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+/*
+ * Blocks until a task is available and copies it into task, along with when
+ * it arrived.  Returns 0 if the manager has no more tasks and the queue is
+ * empty.
+ */
+static int queue_pop(char task[MAX_TASK_SIZE], double* arrival_time) {
+    pthread_mutex_lock(&queue.lock);
+    while (!queue.count && !queue.done) {
+        pthread_cond_wait(&queue.changed, &queue.lock);
+    }
+    int got_task = queue.count > 0;
+    if (got_task) {
+        strcpy(task, queue.tasks[queue.start]);
+        *arrival_time = queue.arrival_times[queue.start];
+        queue.start = (queue.start + 1) % queue.size;
+        queue.count--;
+    }
+    pthread_mutex_unlock(&queue.lock);
+    return got_task;
+}
+
+
+/***** Workers *****/
+
+// Output of one task, in the same format check_keys prints
+struct result_buffer {
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+static void append_key(uint64_t key, void* arg) {
+    struct result_buffer* result = arg;
+    if (result->length + 20 > result->capacity) {
+        result->capacity = result->capacity*2 + 64;
+        result->data = realloc(result->data, result->capacity);
+    }
+    result->length += sprintf(result->data + result->length, "0x%014lx\n", key);
+}
+
+/*
+ * Splits a "plaintext:ciphertext:prefix" task.  Returns the prefix, or NULL
+ * if task is only a prefix.
+ */
+static const char* parse_job_task(const char* task, uint64_t* plaintext, uint64_t* ciphertext) {
+    char* end;
+    if (!strchr(task, ':')) {
+        return NULL;
+    }
+    *plaintext = strtoull(task, &end, 16);
+    if (end != task + 16 || *end != ':') {
+        return NULL;
+    }
+    *ciphertext = strtoull(task + 17, &end, 16);
+    if (end != task + 33 || *end != ':') {
+        return NULL;
+    }
+    return task + 34;
+}
+
+static void* worker_thread(void* arg) {
+    (void) arg;
+    char task[MAX_TASK_SIZE];
+    bs_t keys_zipped[56];
+    struct result_buffer result = {NULL, 0, 0};
+    const struct key_search input_search = {
+#ifdef CIPHERTEXT_ONLY_MODE
+        .predicate = &predicate,
+#else
+        .plaintext_zipped = plaintext_zipped,
+        .ciphertext_zipped = ciphertext_zipped,
+#endif
+#ifdef NUM_EXTRA_PAIRS
+        .num_extra_pairs = NUM_EXTRA_PAIRS,
+        .extra_plaintexts_zipped = extra_plaintexts_zipped,
+        .extra_ciphertexts_zipped = extra_ciphertexts_zipped,
+#endif
+#ifdef COMPLEMENT_MODE
+        .complement_zipped = complement_zipped,
+#endif
+        .num_chunk_bits = NUM_CHUNK_BITS,
+        .found_key = append_key,
+        .found_key_arg = &result
+    };
+
+    // Searches for a job's pair, instead of the one in input.h
+    uint64_t job_plaintext_zipped[64];
+    uint64_t job_ciphertext_zipped[64];
+    uint64_t job_plaintext = 0, job_ciphertext = 0;
+    int have_job_pair = 0;
+    const struct key_search job_search = {
+        .plaintext_zipped = job_plaintext_zipped,
+        .ciphertext_zipped = job_ciphertext_zipped,
+        .num_chunk_bits = NUM_CHUNK_BITS,
+        .found_key = append_key,
+        .found_key_arg = &result
+    };
+
+    double arrival_time;
+    while (queue_pop(task, &arrival_time)) {
+
+        double start_time = now();
+
+        const struct key_search* search = &input_search;
+        uint64_t plaintext, ciphertext;
+        const char* prefix = parse_job_task(task, &plaintext, &ciphertext);
+        if (prefix) {
+            if (!have_job_pair || plaintext != job_plaintext || ciphertext != job_ciphertext) {
+                set_pair(plaintext, ciphertext, job_plaintext_zipped, job_ciphertext_zipped);
+                job_plaintext = plaintext;
+                job_ciphertext = ciphertext;
+                have_job_pair = 1;
+            }
+            search = &job_search;
+        } else {
+            prefix = task;
+        }
+
+        printf("== Worker %ld == Checking Prefix: %s\n", worker_id, task);
+        fflush(stdout);
+        if (set_key_prefix(keys_zipped, prefix, NUM_CHUNK_BITS)) {
+            fprintf(stderr, "Invalid task from manager: \"%s\".  Was input.h "
+                    "generated with the same NUM_CHUNK_BITS as the manager's?\n", task);
+            exit(1);
+        }
+
+        result.length = 0;
+        check_key_chunk(search, keys_zipped);
+
+        if (send_result(task, result.data ? result.data : "", result.length,
+                        start_time - arrival_time, now() - start_time)) {
+            fprintf(stderr, "Lost connection to manager\n");
+            exit(1);
+        }
+
+    }
+
+    free(result.data);
+    return NULL;
+}
+
+/*
+ * The thread count autotune.py found fastest on this host, from
+ * tune-<hostname>.mk in the current directory.  Returns 0 if there isn't
+ * one.
+ */
+static long tuned_threads() {
+    char hostname[256];
+    char filename[300];
+    char line[256];
+    long threads = 0;
+
+    if (gethostname(hostname, sizeof(hostname))) {
+        return 0;
+    }
+    hostname[sizeof(hostname)-1] = '\0';
+    snprintf(filename, sizeof(filename), "tune-%s.mk", hostname);
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "THREADS = %ld", &threads);
+    }
+    fclose(f);
+    return threads;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options] [address:]port\n"
+        "\n"
+        "Start a multithreaded worker for a DES crack manager.  Address defaults to\n"
+        "localhost.\n"
+        "\n"
+        "Options:\n"
+        "  -s SECRET   Preshared secret that the manager was started with.\n"
+        "  -t THREADS  Number of threads.  Default is what autotune.py found fastest,\n"
+        "              or the number of cores.\n"
+        "  -q QUEUE    Number of tasks to keep waiting for a free thread.  Default 2.\n",
+        name);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+
+    const char* secret = NULL;
+    long num_threads = tuned_threads();
+    int queue_size = 2;
+    if (num_threads < 1) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:q:h")) != -1) {
+        switch (opt) {
+            case 's':
+                secret = optarg;
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'q':
+                queue_size = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc-1 || num_threads < 1 || queue_size < 0) {
+        usage(argv[0]);
+    }
+
+    // Parse address, port
+    char address[256] = "127.0.0.1";
+    const char* port = argv[optind];
+    const char* colon = strrchr(argv[optind], ':');
+    if (colon) {
+        size_t address_length = colon - argv[optind];
+        if (address_length >= sizeof(address)) {
+            usage(argv[0]);
+        }
+        if (address_length) {
+            memcpy(address, argv[optind], address_length);
+            address[address_length] = '\0';
+        }
+        port = colon + 1;
+    }
+
+    manager_fd = connect_to_manager(address, port);
+    if (manager_fd < 0) {
+        fprintf(stderr, "Could not connect to manager at %s:%s\n", address, port);
+        return 1;
+    }
+    if (secret && authenticate(secret)) {
+        fprintf(stderr, "Authentication failed, probably due to key mismatch\n");
+        return 1;
+    }
+
+    // Receive worker identifier
+    static unsigned char buffer[MAX_MESSAGE_SIZE];
+    struct message message;
+    long length = recv_bytes(buffer);
+    if (length < 0) {
+        fprintf(stderr, "Lost connection to manager\n");
+        return 1;
+    }
+    unpickle(buffer, length, &message);
+    if (message.type != MESSAGE_INT) {
+        fprintf(stderr, "Unexpected message from manager\n");
+        return 1;
+    }
+    worker_id = message.integer;
+    printf("== Worker %ld == Connected to manager at %s:%s with %ld threads\n",
+           worker_id, address, port, num_threads);
+    fflush(stdout);
+
+    // Every thread has a task and queue_size more are waiting.  The manager
+    // sends two on its own.
+    queue.size = num_threads + queue_size;
+    if (queue.size < 2) {
+        queue.size = 2;
+    }
+    queue.tasks = malloc(queue.size * MAX_TASK_SIZE);
+    queue.arrival_times = malloc(queue.size * sizeof(double));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.changed, NULL);
+    for (int i=2; i<queue.size; i++) {
+        if (request_task()) {
+            fprintf(stderr, "Lost connection to manager\n");
+            return 1;
+        }
+    }
+
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    for (int i=0; i<num_threads; i++) {
+        pthread_create(&threads[i], NULL, worker_thread, NULL);
+    }
+
+    // Receive tasks until the manager runs out
+    while ((length = recv_bytes(buffer)) >= 0) {
+        unpickle(buffer, length, &message);
+        if (message.type == MESSAGE_STRING) {
+            queue_push(message.string);
+        } else if (message.type == MESSAGE_FALSE) {
+            break;
+        } else {
+            fprintf(stderr, "Unexpected message from manager\n");
+            break;
+        }
+    }
+    queue_finish();
+
+    for (int i=0; i<num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Closing with unread messages (the manager answers every result with
+    // False by now) would reset the connection and could lose the last
+    // results.  Instead, wait for the manager to close its side.
+    shutdown(manager_fd, SHUT_WR);
+    while (recv_bytes(buffer) >= 0);
+    close(manager_fd);
+    return 0;
+
+}
@@ -0,0 +1,223 @@
+/*
+ * Hardware counter instrumentation for check_keys, using perf_event_open.
+ *
+ * Include this before check_keys.h to define the INSTRUMENT_* hooks that
+ * check_key_chunk calls.  Counters are read around the whole chunk, and
+ * around each sampled batch and each phase within it, for one in every
+ * PERF_SAMPLE_INTERVAL batches of keys.  Reading a counter is a system
+ * call, so timing every batch would mostly measure the instrumentation
+ * itself.
+ *
+ * The cost of one read, measured at startup, is subtracted for every
+ * start/end pair taken, since a phase can be entered more than once per
+ * batch.  Sampled batches still run slower than the rest, as the system
+ * calls disturb caches and branch predictors.  So rather than scale the
+ * sampled counts up, each phase is reported as its share of the sampled
+ * batches times the chunk total.  The rest of the sampled time is reported
+ * as "other", and the phases and "other" always add up to the total.
+ *
+ * Counters that can't be opened (no PMU in a virtual machine, or a high
+ * /proc/sys/kernel/perf_event_paranoid) are reported as null.  Only kernel
+ * time is excluded, so this is only meaningful single threaded.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#ifndef PERF_SAMPLE_INTERVAL
+#define PERF_SAMPLE_INTERVAL 1024
+#endif
+
+enum perf_counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_TASK_CLOCK,  // Nanoseconds on the CPU
+    NUM_COUNTERS
+};
+
+static const char* counter_names[NUM_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "task_clock_ns"
+};
+
+enum perf_phase {
+    PHASE_DECRYPT,
+    PHASE_COMPARE,
+    PHASE_INCREMENT,
+    NUM_PHASES
+};
+
+static const char* phase_names[NUM_PHASES] = {
+    "decrypt", "compare", "increment"
+};
+
+static int counter_fds[NUM_COUNTERS];
+static uint64_t phase_totals[NUM_PHASES][NUM_COUNTERS];
+static uint64_t phase_pairs[NUM_PHASES];  // Start/end pairs sampled
+static uint64_t phase_start[NUM_COUNTERS];
+static uint64_t batch_totals[NUM_COUNTERS];  // Of sampled batches
+static uint64_t batch_start[NUM_COUNTERS];
+static uint64_t chunk_start[NUM_COUNTERS];
+static uint64_t batch_count;
+static uint64_t sampled_count;
+static int batch_sampled;
+static double read_overhead[NUM_COUNTERS];  // Per start/end pair
+
+static int perf_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_read(uint64_t values[NUM_COUNTERS]) {
+    for (int i=0; i<NUM_COUNTERS; i++) {
+        if (counter_fds[i] < 0 || read(counter_fds[i], &values[i], 8) != 8) {
+            values[i] = 0;
+        }
+    }
+}
+
+static void perf_init() {
+    counter_fds[COUNTER_CYCLES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counter_fds[COUNTER_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counter_fds[COUNTER_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D |
+        PERF_COUNT_HW_CACHE_OP_READ << 8 |
+        PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    counter_fds[COUNTER_TASK_CLOCK] = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+
+    // Calibrate: time an empty phase
+    uint64_t start[NUM_COUNTERS], end[NUM_COUNTERS];
+    for (int i=0; i<1000; i++) {
+        perf_read(start);
+        perf_read(end);
+        for (int counter=0; counter<NUM_COUNTERS; counter++) {
+            read_overhead[counter] += (end[counter] - start[counter]) / 1000.0;
+        }
+    }
+}
+
+#define INSTRUMENT_CHUNK_START() perf_read(chunk_start)
+
+#define INSTRUMENT_BATCH() \
+    batch_sampled = (batch_count++ % PERF_SAMPLE_INTERVAL == 0); \
+    sampled_count += batch_sampled; \
+    if (batch_sampled) { \
+        perf_read(batch_start); \
+    }
+
+#define INSTRUMENT_BATCH_END() \
+    if (batch_sampled) { \
+        uint64_t batch_end[NUM_COUNTERS]; \
+        perf_read(batch_end); \
+        for (int counter=0; counter<NUM_COUNTERS; counter++) { \
+            batch_totals[counter] += batch_end[counter] - batch_start[counter]; \
+        } \
+    }
+
+#define INSTRUMENT_PHASE_START(phase) \
+    if (batch_sampled) { \
+        perf_read(phase_start); \
+    }
+
+#define INSTRUMENT_PHASE_END(phase) \
+    if (batch_sampled) { \
+        uint64_t phase_end[NUM_COUNTERS]; \
+        perf_read(phase_end); \
+        for (int counter=0; counter<NUM_COUNTERS; counter++) { \
+            phase_totals[PHASE_ ## phase][counter] += phase_end[counter] - phase_start[counter]; \
+        } \
+        phase_pairs[PHASE_ ## phase]++; \
+    }
+
+static void perf_print_value(FILE* out, int counter, double value) {
+    if (counter_fds[counter] < 0) {
+        fprintf(out, "null");
+    } else {
+        fprintf(out, "%.0f", value);
+    }
+}
+
+/*
+ * Prints one line of JSON describing the chunk just searched.
+ */
+static void perf_report(FILE* out, const char* prefix, int num_chunk_bits) {
+    uint64_t chunk_end[NUM_COUNTERS];
+    double totals[NUM_COUNTERS];
+    perf_read(chunk_end);
+    for (int i=0; i<NUM_COUNTERS; i++) {
+        totals[i] = chunk_end[i] - chunk_start[i];
+    }
+
+    double keys = (double) (1ULL << num_chunk_bits);
+    double seconds = totals[COUNTER_TASK_CLOCK] / 1e9;
+    int have_cycles = counter_fds[COUNTER_CYCLES] >= 0;
+    int have_instructions = counter_fds[COUNTER_INSTRUCTIONS] >= 0;
+
+    fprintf(out, "{\"prefix\": \"%s\", \"keys\": %.0f, \"seconds\": %f, ", prefix, keys, seconds);
+    fprintf(out, "\"keys_per_second\": %.0f, ", seconds > 0 ? keys / seconds : 0);
+    for (int i=0; i<NUM_COUNTERS; i++) {
+        fprintf(out, "\"%s\": ", counter_names[i]);
+        perf_print_value(out, i, totals[i]);
+        fprintf(out, ", ");
+    }
+    if (have_cycles && have_instructions && totals[COUNTER_CYCLES] > 0) {
+        fprintf(out, "\"ipc\": %.3f, ", totals[COUNTER_INSTRUCTIONS] / totals[COUNTER_CYCLES]);
+    } else {
+        fprintf(out, "\"ipc\": null, ");
+    }
+    if (have_cycles) {
+        fprintf(out, "\"cycles_per_key\": %.2f, ", totals[COUNTER_CYCLES] / keys);
+        fprintf(out, "\"ghz\": %.3f, ", seconds > 0 ? totals[COUNTER_CYCLES] / seconds / 1e9 : 0);
+    } else {
+        fprintf(out, "\"cycles_per_key\": null, \"ghz\": null, ");
+    }
+
+    // Each phase pair inside a sampled batch costs the batch two reads: one
+    // read's worth inside the phase and one outside it.  The batch's own
+    // start and end reads add one more.
+    uint64_t num_pairs = 0;
+    for (int phase=0; phase<NUM_PHASES; phase++) {
+        num_pairs += phase_pairs[phase];
+    }
+    double phases[NUM_PHASES+1][NUM_COUNTERS];  // The last is "other"
+    for (int i=0; i<NUM_COUNTERS; i++) {
+        double sampled = batch_totals[i] - read_overhead[i] * (sampled_count + 2*num_pairs);
+        double sum = 0;
+        for (int phase=0; phase<NUM_PHASES; phase++) {
+            double value = phase_totals[phase][i] - read_overhead[i] * phase_pairs[phase];
+            phases[phase][i] = value > 0 ? value : 0;
+            sum += phases[phase][i];
+        }
+        // Measurement noise can leave less sampled time than the phases add
+        // up to.  Then there's nothing left for "other".
+        if (sampled < sum) {
+            sampled = sum;
+        }
+        phases[NUM_PHASES][i] = sampled - sum;
+        for (int phase=0; phase<=NUM_PHASES; phase++) {
+            phases[phase][i] = sampled > 0 ? phases[phase][i] / sampled * totals[i] : 0;
+        }
+    }
+
+    fprintf(out, "\"sample_interval\": %d, \"phases\": {", PERF_SAMPLE_INTERVAL);
+    for (int phase=0; phase<=NUM_PHASES; phase++) {
+        fprintf(out, "\"%s\": {", phase < NUM_PHASES ? phase_names[phase] : "other");
+        for (int i=0; i<NUM_COUNTERS; i++) {
+            fprintf(out, "\"%s\": ", counter_names[i]);
+            perf_print_value(out, i, phases[phase][i]);
+            fprintf(out, i == NUM_COUNTERS-1 ? "}" : ", ");
+        }
+        fprintf(out, phase == NUM_PHASES ? "}}\n" : ", ");
+    }
+}
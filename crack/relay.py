@@ -0,0 +1,116 @@
+"""
+A relay between the manager and a group of workers, such as one rack or
+site.  The workers connect to the relay, and the relay connects to the
+manager as a single worker.
+
+Start the manager with --chunk-bits larger than the workers' NUM_CHUNK_BITS
+so each of its tasks is a large range.  The relay splits each one into
+chunks of this directory's input.h NUM_CHUNK_BITS for its workers, and
+sends the found keys back in batches.
+
+"""
+
+import re
+import sys
+import os.path
+from time import time
+from optparse import OptionParser
+
+# Add lib/ to sys.path
+lib_directory = os.path.realpath(os.path.join(__file__, "../../lib/"))
+sys.path.append(lib_directory)
+
+from distproc import RelayManager
+from shard import get_num_chunk_bits
+
+def parse_address(op, string, default_address):
+    match = re.match("^((.*):)?(.*)$", string)
+    address = match.group(2) or default_address
+    port = None
+    try:
+        port = int(match.group(3))
+    except ValueError: pass
+    if not port:
+        op.error("Invalid port number: '%s'" % string)
+    return address, port
+
+class DesRelayManager(RelayManager):
+
+    work_unit_name = "keys"
+
+    def __init__(self, *args, **kwargs):
+        self.num_chunk_bits = get_num_chunk_bits()
+        self.start_time = time()
+        super(DesRelayManager, self).__init__(*args, **kwargs)
+
+    def subdivide(self, task):
+        '''
+        Splits "[plaintext:ciphertext:]prefix" into every longer prefix that
+        is one chunk for the local workers.
+        '''
+        fields = task.split(":")
+        prefix = fields[-1]
+        bits = 56 - self.num_chunk_bits - len(prefix)
+        if bits < 0:
+            raise ValueError("Task %s is smaller than a chunk.  Start the "
+                "manager with --chunk-bits of at least %d." % (task, self.num_chunk_bits))
+        return [":".join(fields[:-1] + [prefix + format(i, "0%db" % bits) if bits else prefix])
+                for i in xrange(2**bits)]
+
+    def combine_results(self, task, results):
+        return "".join(result or "" for result in results)
+
+    def work_units(self, task_data):
+        return 2**self.num_chunk_bits
+
+    def process_result(self, worker_id, task_data, result):
+        super(DesRelayManager, self).process_result(worker_id, task_data, result)
+        if result:
+            self.log("==Worker %s== Found match in %.2f seconds: %s" % (worker_id, time()-self.start_time, result))
+
+if __name__ == "__main__":
+
+    op = OptionParser(
+        usage="%prog [options] manager-address:port [bind-address]:port",
+        description="Relay tasks from a DES crack manager to local workers, "
+        "which connect to the second address instead of to the manager."
+    )
+    op.add_option("-S", "--parent-secret", type="string", dest="parent_secret", default=None,
+        help="Preshared secret that the manager was started with.")
+    op.add_option("-s", "--secret", type="string", dest="secret", default=None,
+        help="Preshared secret that local workers must use to authenticate.")
+    op.add_option("-b", "--batch-size", type="int", dest="batch_size", default=16,
+        help="Send finished tasks to the manager once this many are "
+        "waiting.  Default 16.")
+    op.add_option("-i", "--batch-interval", type="float", dest="batch_interval", default=5.0,
+        help="Send finished tasks to the manager once the oldest has waited "
+        "this many seconds, even if the batch isn't full.  Default 5.")
+    op.add_option("-m", "--metrics", type="string", dest="metrics", default=None,
+        help="Serve metrics for the local workers over HTTP in the Prometheus "
+        "text format on [address:]port.  Address defaults to localhost.")
+
+    options, args = op.parse_args()
+    if len(args) != 2:
+        op.error("Give the manager's address and the address to listen on")
+    if options.batch_size < 1 or options.batch_interval < 0:
+        op.error("--batch-size must be at least 1 and --batch-interval can't be negative")
+    parent_address, parent_port = parse_address(op, args[0], "127.0.0.1")
+    address, port = parse_address(op, args[1], "")
+
+    metrics_address = None
+    if options.metrics:
+        match = re.match("^((.*):)?(\d+)$", options.metrics)
+        if match is None:
+            op.error("Metrics address must be in the format [address:]port")
+        metrics_address = (match.group(2) or '127.0.0.1', int(match.group(3)))
+
+    try:
+        relay = DesRelayManager(parent_address, parent_port, address, port,
+                                parent_authkey=options.parent_secret,
+                                authkey=options.secret,
+                                metrics_address=metrics_address,
+                                batch_size=options.batch_size,
+                                batch_seconds=options.batch_interval)
+        relay.run()
+    except (IOError, ValueError) as e:
+        sys.exit(str(e))
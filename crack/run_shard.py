@@ -0,0 +1,145 @@
+"""
+Runs a shard exported by shard.py, for machines that can't reach the
+manager.  Needs check_keys built from an input.h with the same
+NUM_CHUNK_BITS (and for input.h searches, the same input.h).
+
+Tasks are run as several check_keys processes at once.  The manifest is
+rewritten as tasks finish, so an interrupted run can be continued by
+running it again, and a partial manifest can be imported too.
+
+"""
+
+import os
+import sys
+import time
+import socket
+from multiprocessing import cpu_count
+from optparse import OptionParser
+from subprocess import Popen, PIPE
+
+from autotune import read_tune_file
+from shard import SHARD_FORMAT, MANIFEST_FORMAT, FORMAT_VERSION, RangeSet, \
+    read_json, write_json, task_string, keys_from_output, get_num_chunk_bits, \
+    input_h_checksum
+
+# Seconds between manifest writes
+MANIFEST_INTERVAL = 10
+
+def check_shard(shard):
+    '''Raises ValueError if this check_keys build can't run the shard.'''
+    if get_num_chunk_bits() != shard["num_chunk_bits"]:
+        raise ValueError("Shard needs NUM_CHUNK_BITS %d, but input.h has %d" %
+                         (shard["num_chunk_bits"], get_num_chunk_bits()))
+    if shard["plaintext"] is None and input_h_checksum() != shard["input_h_checksum"]:
+        raise ValueError("Shard is for the search of a different input.h")
+
+def write_manifest(filename, shard, completed, keys, seconds):
+    write_json(filename, {
+        "format": MANIFEST_FORMAT,
+        "version": FORMAT_VERSION,
+        "shard": shard["shard"],
+        "shard_checksum": shard["checksum"],
+        "search": shard["search"],
+        "host": socket.gethostname(),
+        "seconds": seconds,
+        "completed": completed.ranges(),
+        "keys": keys,
+    })
+
+def run(shard, manifest_filename, num_processes):
+
+    # Continue from an earlier manifest
+    completed = RangeSet()
+    keys = []
+    seconds = 0.0
+    if os.path.exists(manifest_filename):
+        manifest = read_json(manifest_filename, MANIFEST_FORMAT)
+        if manifest["shard_checksum"] != shard["checksum"]:
+            raise ValueError("%s is the manifest of a different shard" % manifest_filename)
+        for first, count in manifest["completed"]:
+            completed.add(first, count)
+        keys = manifest["keys"]
+        seconds = manifest["seconds"]
+        print "Continuing: %d of %d tasks already done" % (len(completed), shard["count"])
+
+    remaining = [i for i in xrange(shard["first"], shard["first"] + shard["count"])
+                 if i not in completed]
+    remaining.reverse()
+    running = {}  # Maps processes to task indexes
+    start = time.time()
+    last_write = start
+
+    try:
+        while remaining or running:
+            while remaining and len(running) < num_processes:
+                index = remaining.pop()
+                args = ["./check_keys"] + task_string(shard["search"], shard["task_bits"], index).split(":")
+                running[Popen(args, stdout=PIPE)] = index
+
+            # Wait for any process.  check_keys runs for seconds at least,
+            # so polling is fine.
+            finished = [process for process in running if process.poll() is not None]
+            if not finished:
+                time.sleep(0.05)
+                continue
+            for process in finished:
+                index = running.pop(process)
+                output = process.stdout.read()
+                if process.returncode:
+                    raise RuntimeError("check_keys failed on task %d: %s" % (index, output.strip()))
+                completed.add(index, 1)
+                for key in keys_from_output(output):
+                    print "Found key:", key
+                    keys.append(key)
+
+            now = time.time()
+            if now - last_write >= MANIFEST_INTERVAL or not (remaining or running):
+                write_manifest(manifest_filename, shard, completed, keys, seconds + now - start)
+                last_write = now
+                print "%d of %d tasks done" % (len(completed), shard["count"])
+                sys.stdout.flush()
+
+    finally:
+        for process in running:
+            try:
+                process.kill()
+            except OSError: pass
+        write_manifest(manifest_filename, shard, completed, keys, seconds + time.time() - start)
+
+    return completed, keys
+
+if __name__ == "__main__":
+
+    op = OptionParser(
+        usage="%prog [options] shard.json",
+        description="Runs the tasks of a shard from shard.py with check_keys, "
+        "and writes a manifest to take back to the manager's journal.")
+    op.add_option("-c", "--count", type="int", dest="count",
+        default=int(read_tune_file().get("THREADS", cpu_count())),
+        help="Number of check_keys processes.  Default is the thread count "
+        "autotune.py found fastest, or the number of cores.")
+    op.add_option("-o", "--output", type="string", dest="output", default=None,
+        help="Manifest file.  Default is manifest-<shard id>.json.")
+    options, args = op.parse_args()
+    if len(args) != 1:
+        op.error("Give one shard file")
+    if options.count < 1:
+        op.error("--count must be at least 1")
+
+    try:
+        shard = read_json(args[0], SHARD_FORMAT)
+        check_shard(shard)
+    except (IOError, ValueError) as e:
+        sys.exit(str(e))
+    manifest_filename = options.output or "manifest-%s.json" % shard["shard"]
+
+    print "Shard %s: %d tasks, %s to %s" % (shard["shard"], shard["count"], shard["first_task"], shard["last_task"])
+    try:
+        completed, keys = run(shard, manifest_filename, options.count)
+    except KeyboardInterrupt:
+        print
+        print "Interrupted.  Run again to continue; %s has the progress so far." % manifest_filename
+        sys.exit(1)
+    except (ValueError, RuntimeError) as e:
+        sys.exit(str(e))
+    print "Wrote %s.  Keys: %s" % (manifest_filename, keys)
@@ -23,6 +23,23 @@ def preprocess_ciphertext(bits):
     # Initial Permutation
     return bittools.permute(bits, desconst.INITIAL_PERMUTATION)
 
+def complement(bits):
+    return [1-bit for bit in bits]
+
+def plaintext_positions():
+    '''
+    Where each plaintext bit ends up after preprocess_plaintext, which is also
+    where des_decrypt leaves it.
+    '''
+    processed = preprocess_plaintext(range(64))
+    return [processed.index(i) for i in range(64)]
+
+def format_indexes(indexes, indent="    "):
+    lines = []
+    for i in range(0, len(indexes), 16):
+        lines.append(indent + ", ".join("%2d" % index for index in indexes[i:i+16]))
+    return ",\n".join(lines)
+
 def zip_and_format(bits):
     result = ""
 
@@ -42,49 +59,223 @@ def zip_and_format(bits):
 
     return result
 
+def write_predicate(f, blocks, chaining, known_mask, known_value, printable):
+    '''Writes the input for a ciphertext only search.  See check_keys.h.'''
+    f.write("#define CIPHERTEXT_ONLY_MODE\n\n")
+    f.write("#define NUM_BLOCKS %d\n\n" % len(blocks))
+
+    f.write("static const uint64_t blocks_zipped[NUM_BLOCKS][64] = {\n")
+    for block in blocks:
+        f.write("{\n    // Unprocessed ciphertext: 0x%s\n" % bittools.bits_to_hex(block))
+        f.write(zip_and_format(preprocess_ciphertext(block)))
+        f.write("\n},\n")
+    f.write("};\n\n")
+
+    f.write("static const uint64_t chaining_zipped[NUM_BLOCKS][64] = {\n")
+    for value in chaining:
+        f.write("{\n    // Unprocessed: 0x%s\n" % bittools.bits_to_hex(value))
+        f.write(zip_and_format(preprocess_plaintext(value)))
+        f.write("\n},\n")
+    f.write("};\n\n")
+
+    positions = plaintext_positions()
+    known_bits = [positions[i] for i in range(64) if known_mask[i]]
+    f.write("static const uint64_t known_zipped[64] = {\n\n")
+    f.write("    // Unprocessed: 0x%s, mask 0x%s\n" % (
+        bittools.bits_to_hex(known_value), bittools.bits_to_hex(known_mask)))
+    f.write(zip_and_format(preprocess_plaintext(known_value)))
+    f.write("\n};\n\n")
+
+    # An empty initializer isn't valid C
+    f.write("static const unsigned char known_bits[] = {\n")
+    f.write(format_indexes(known_bits or [0]))
+    f.write("\n};\n\n")
+
+    f.write("static const unsigned char byte_bits[8][8] = {\n")
+    f.write(",\n".join("    {%s}" % format_indexes(positions[i:i+8], "")
+                       for i in range(0, 64, 8)))
+    f.write("\n};\n\n")
+
+    f.write("static const struct plaintext_predicate predicate = {\n")
+    f.write("    .num_blocks = NUM_BLOCKS,\n")
+    f.write("    .blocks_zipped = blocks_zipped,\n")
+    f.write("    .chaining_zipped = chaining_zipped,\n")
+    f.write("    .num_known_bits = %d,\n" % len(known_bits))
+    f.write("    .known_bits = known_bits,\n")
+    f.write("    .known_zipped = known_zipped,\n")
+    f.write("    .printable = %d,\n" % int(printable))
+    f.write("    .byte_bits = byte_bits\n")
+    f.write("};")
+
+def write_pair(f, plaintext_hex, ciphertext_hex, complement_hex, extra_pairs):
+    '''Writes the input for a known plaintext search.'''
+    plaintext = bittools.hex_to_bits(plaintext_hex)
+    ciphertext = bittools.hex_to_bits(ciphertext_hex)
+
+    # In complement mode check_keys encrypts instead of decrypts, so the
+    # plaintext and ciphertext trade preprocessing.
+    if complement_hex is None:
+        processed_plaintext = preprocess_plaintext(plaintext)
+        processed_ciphertext = preprocess_ciphertext(ciphertext)
+    else:
+        f.write("#define COMPLEMENT_MODE\n\n")
+        processed_plaintext = preprocess_ciphertext(plaintext)
+        processed_ciphertext = preprocess_plaintext(ciphertext)
+
+    f.write("static uint64_t plaintext_zipped[64] = {\n\n")
+    f.write("    // Unprocessed plaintext: 0x%s\n" % plaintext_hex)
+    f.write(zip_and_format(processed_plaintext))
+    f.write("\n};\n\n")
+
+    f.write("static uint64_t ciphertext_zipped[64] = {\n\n")
+    f.write("    // Unprocessed ciphertext: 0x%s\n" % ciphertext_hex)
+    f.write(zip_and_format(processed_ciphertext))
+    f.write("\n};")
+
+    if extra_pairs:
+        f.write("\n\n#define NUM_EXTRA_PAIRS %d" % len(extra_pairs))
+        for name, index, preprocess in [
+                ("plaintexts", 0, preprocess_plaintext),
+                ("ciphertexts", 1, preprocess_ciphertext)]:
+            f.write("\n\nstatic const uint64_t extra_%s_zipped[NUM_EXTRA_PAIRS][64] = {\n" % name)
+            for pair in extra_pairs:
+                f.write("{\n    // Unprocessed: 0x%s\n" % pair[index])
+                f.write(zip_and_format(preprocess(bittools.hex_to_bits(pair[index]))))
+                f.write("\n},\n")
+            f.write("};")
+
+    if complement_hex is not None:
+        processed_complement = complement(preprocess_plaintext(bittools.hex_to_bits(complement_hex)))
+        f.write("\n\nstatic uint64_t complement_zipped[64] = {\n\n")
+        f.write("    // Complement of unprocessed complement ciphertext: 0x%s\n" % complement_hex)
+        f.write(zip_and_format(processed_complement))
+        f.write("\n};")
+
 if __name__ == "__main__":
 
     op = OptionParser(
-        usage="%prog <plaintext> <ciphertext> <num_chunk_bits>",
+        usage="%prog [options] <plaintext> <ciphertext> <num_chunk_bits>\n"
+        "       %prog <predicate options> <ciphertext> <num_chunk_bits>",
         description="Sets up the input for the keysearch by creating 'input.h'. "
         "plaintext and ciphertext must be 64 bits of hex (without the 0x "
         "prefix).  num_chunk_bits specifies the number of bits a single call to "
-        "check_keys will search.  It must be between 6 and 56 inclusive.")
+        "check_keys will search.  It must be between 6 and 56 inclusive.  If "
+        "the plaintext isn't known, give one or more predicate options "
+        "(--printable, --high-bit, --known) instead.  Then ciphertext is one or "
+        "more blocks of 16 hex digits, concatenated, and a key is reported if "
+        "the decryption of every block passes.")
+    op.add_option("-c", "--complement", type="string", dest="complement", default=None,
+        help="Ciphertext of the complement of plaintext, under the same key.  "
+        "Given a chosen plaintext pair like this, only half of the keys need "
+        "to be searched.")
+    op.add_option("-x", "--extra-pair", type="string", dest="extra_pairs",
+        action="append", default=[], metavar="PLAINTEXT:CIPHERTEXT",
+        help="Another known plaintext-ciphertext pair under the same key.  "
+        "Keys that match the first pair are checked against these before "
+        "being reported.  May be given more than once.")
+    op.add_option("-p", "--printable", dest="printable", action="store_true",
+        default=False, help="Predicate: every plaintext byte is printable "
+        "ASCII (0x20 to 0x7e).")
+    op.add_option("-H", "--high-bit", dest="high_bit", action="store_true",
+        default=False, help="Predicate: the high bit of every plaintext byte "
+        "is 0, as in any ASCII text.")
+    op.add_option("-k", "--known", type="string", dest="known", default=None,
+        metavar="MASK:VALUE", help="Predicate: the plaintext bits set in MASK "
+        "are equal to those in VALUE.  Both are 16 hex digits.")
+    op.add_option("--cbc", dest="cbc", action="store_true", default=False,
+        help="Ciphertext blocks are in CBC mode.  Unless --iv is given, the "
+        "first block is only used to undo the chaining of the second.")
+    op.add_option("--iv", type="string", dest="iv", default=None,
+        help="Initialization vector for --cbc, 16 hex digits.")
     (options, args) = op.parse_args()
 
-    if len(args) < 3:
+    ciphertext_only = options.printable or options.high_bit or options.known is not None
+    num_args = 2 if ciphertext_only else 3
+    if len(args) < num_args:
         op.error("Not enough arguments")
-    elif len(args) > 3:
+    elif len(args) > num_args:
         op.error("Too many arguments")
-    plaintext = bittools.hex_to_bits(args[0])
-    ciphertext = bittools.hex_to_bits(args[1])
+    if ciphertext_only:
+        ciphertext_hex = args[0]
+    else:
+        plaintext = bittools.hex_to_bits(args[0])
+        ciphertext_hex = args[1]
+    ciphertext = bittools.hex_to_bits(ciphertext_hex)
     try:
-        num_chunk_bits = int(args[2])
+        num_chunk_bits = int(args[-1])
     except ValueError:
         op.error("num_chunk_bits must be an integer between 6 and 56 inclusive")
 
-    if len(plaintext) != 64:
+    if not ciphertext_only and len(plaintext) != 64:
         op.error("plaintext must be 16 hex digits")
-    if len(ciphertext) != 64:
+    if not ciphertext_only and len(ciphertext) != 64:
         op.error("ciphertext must be 16 hex digits")
     if num_chunk_bits < 6 or num_chunk_bits > 56:
         op.error("num_chunk_bits must be an integer between 6 and 56 inclusive")
+    if options.complement is not None:
+        if ciphertext_only:
+            op.error("--complement needs a known plaintext")
+        complement_ciphertext = bittools.hex_to_bits(options.complement)
+        if len(complement_ciphertext) != 64:
+            op.error("complement ciphertext must be 16 hex digits")
+    extra_pairs = []
+    for pair in options.extra_pairs:
+        if ciphertext_only or options.complement is not None:
+            op.error("--extra-pair can't be used with --complement or a predicate")
+        try:
+            extra_plaintext, extra_ciphertext = pair.split(":")
+        except ValueError:
+            op.error("--extra-pair must be PLAINTEXT:CIPHERTEXT")
+        if len(bittools.hex_to_bits(extra_plaintext)) != 64 or \
+                len(bittools.hex_to_bits(extra_ciphertext)) != 64:
+            op.error("extra plaintexts and ciphertexts must be 16 hex digits")
+        extra_pairs.append((extra_plaintext, extra_ciphertext))
+    if (options.cbc or options.iv) and not ciphertext_only:
+        op.error("--cbc and --iv only apply with a predicate")
+
+    if ciphertext_only:
+        if len(ciphertext) == 0 or len(ciphertext) % 64 != 0:
+            op.error("ciphertext must be one or more blocks of 16 hex digits")
+        blocks = [ciphertext[i:i+64] for i in range(0, len(ciphertext), 64)]
+
+        # Chaining values are xored into the decryption of each block
+        if not options.cbc:
+            chaining = [[0]*64 for block in blocks]
+        elif options.iv is not None:
+            iv = bittools.hex_to_bits(options.iv)
+            if len(iv) != 64:
+                op.error("iv must be 16 hex digits")
+            chaining = [iv] + blocks[:-1]
+        elif len(blocks) < 2:
+            op.error("--cbc without --iv needs at least two blocks")
+        else:
+            chaining = blocks[:-1]
+            blocks = blocks[1:]
+
+        known_mask = [0]*64
+        known_value = [0]*64
+        if options.known is not None:
+            try:
+                mask_hex, value_hex = options.known.split(":")
+            except ValueError:
+                op.error("--known must be MASK:VALUE")
+            known_mask = bittools.hex_to_bits(mask_hex)
+            known_value = bittools.hex_to_bits(value_hex)
+            if len(known_mask) != 64 or len(known_value) != 64:
+                op.error("--known mask and value must be 16 hex digits each")
+        if options.high_bit:
+            for i in range(0, 64, 8):
+                known_mask[i] = 1
+                known_value[i] = 0
 
     f = open("input.h", 'w')
 
     f.write("#define NUM_CHUNK_BITS %d\n\n" % num_chunk_bits)
 
-    processed_plaintext = preprocess_plaintext(plaintext)
-    f.write("static uint64_t plaintext_zipped[64] = {\n\n")
-    f.write("    // Unprocessed plaintext: 0x%s\n" % args[0])
-    f.write(zip_and_format(processed_plaintext))
-    f.write("\n};\n\n")
-
-    processed_ciphertext = preprocess_ciphertext(ciphertext)
-    f.write("static uint64_t ciphertext_zipped[64] = {\n\n")
-    f.write("    // Unprocessed ciphertext: 0x%s\n" % args[1])
-    f.write(zip_and_format(processed_ciphertext))
-    f.write("\n};")
+    if ciphertext_only:
+        write_predicate(f, blocks, chaining, known_mask, known_value, options.printable)
+    else:
+        write_pair(f, args[0], ciphertext_hex, options.complement, extra_pairs)
 
     # Ending newline may be required for include files
     f.write("\n")
@@ -0,0 +1,445 @@
+"""
+Offline shards: ranges of a search's tasks that are run away from the
+manager, on machines that can't connect to it.
+
+A shard file describes everything needed to run its tasks: the search (a
+job's pair, or a checksum of the input.h it needs), NUM_CHUNK_BITS and a
+range of task indexes.  run_shard.py runs it with check_keys and writes a
+manifest of the tasks it finished and the keys it found.  Importing the
+manifest records those tasks as done.
+
+Progress is kept in a journal, an append-only text file that the manager
+(with --journal) and this script both read and write.  Each line is one
+event:
+
+    done SEARCH FIRST COUNT     Tasks FIRST to FIRST+COUNT-1 are finished
+    redo SEARCH FIRST COUNT     The tasks aren't finished after all: the
+                                worker that did them failed a spot check
+    found SEARCH KEY            A key was found
+    export SHARD SEARCH FIRST COUNT
+                                Tasks were exported to a shard
+    release SHARD               The shard's tasks that aren't done can be
+                                given out again
+
+SEARCH identifies a search and the numbering of its tasks.  Task i is the
+search's prefix followed by i in binary (see task_prefix()).
+
+"""
+
+import os
+import re
+import sys
+import json
+import time
+import bisect
+import hashlib
+from binascii import hexlify
+from optparse import OptionParser
+
+SHARD_FORMAT = "des-crack-shard"
+MANIFEST_FORMAT = "des-crack-manifest"
+FORMAT_VERSION = 1
+
+def input_h_checksum(filename="input.h"):
+    with open(filename) as f:
+        return hashlib.sha256(f.read()).hexdigest()[:16]
+
+def job_search_id(plaintext, ciphertext, prefix):
+    '''A job's search, from manager.py --job.'''
+    return "%s:%s:%s" % (plaintext, ciphertext, prefix)
+
+def input_search_id(prefix, filename="input.h"):
+    '''The search of the pair in input.h, which only a matching build can run.'''
+    return "input.h-%s:%s" % (input_h_checksum(filename), prefix)
+
+def get_complement_mode(filename="input.h"):
+    '''Whether input.h was generated with a complementary pair.'''
+    with open(filename) as f:
+        return "#define COMPLEMENT_MODE" in f.read()
+
+def input_search_prefix(prefix, filename="input.h"):
+    '''
+    The prefix the search of input.h really uses.  In complement mode, each
+    key checked also checks its complement, so with no prefix given, fixing
+    the first key bit to 0 covers the other half.  With a prefix, the
+    complements are outside of it, so nothing is saved.
+    '''
+    if not prefix and get_complement_mode(filename):
+        return "0"
+    return prefix
+
+def parse_search_id(search_id):
+    '''
+    Returns (plaintext, ciphertext, prefix), with plaintext and ciphertext
+    None for an input.h search.
+    '''
+    fields = search_id.split(":")
+    if len(fields) == 2:
+        return None, None, fields[1]
+    return fields[0], fields[1], fields[2]
+
+def task_prefix(prefix, task_bits, index):
+    '''The key prefix of task index of a search.'''
+    return prefix + (bin(index)[2:].rjust(task_bits, '0') if task_bits else "")
+
+def task_string(search_id, task_bits, index):
+    '''The task as the manager sends it, and check_keys takes it.'''
+    plaintext, ciphertext, prefix = parse_search_id(search_id)
+    key_prefix = task_prefix(prefix, task_bits, index)
+    if plaintext is None:
+        return key_prefix
+    return "%s:%s:%s" % (plaintext, ciphertext, key_prefix)
+
+def checksum(obj):
+    '''SHA-256 of obj's canonical JSON, without its own checksum.'''
+    obj = dict((k, v) for k, v in obj.items() if k != "checksum")
+    return hashlib.sha256(json.dumps(obj, sort_keys=True, separators=(",", ":"))).hexdigest()
+
+def write_json(filename, obj):
+    '''Writes obj with its checksum, atomically.'''
+    obj = dict(obj)
+    obj["checksum"] = checksum(obj)
+    temp = filename + ".tmp"
+    with open(temp, "w") as f:
+        json.dump(obj, f, indent=1, sort_keys=True)
+        f.write("\n")
+    os.rename(temp, filename)
+
+def read_json(filename, format):
+    '''Reads a shard or manifest, checking its format and checksum.'''
+    with open(filename) as f:
+        obj = json.load(f)
+    if obj.get("format") != format:
+        raise ValueError("%s is not a %s file" % (filename, format))
+    if obj.get("version") != FORMAT_VERSION:
+        raise ValueError("%s has unsupported version %s" % (filename, obj.get("version")))
+    if obj.get("checksum") != checksum(obj):
+        raise ValueError("%s is corrupt: checksum does not match" % filename)
+    return obj
+
+
+class RangeSet(object):
+    '''A set of integers, stored as sorted, merged [start, end) ranges.'''
+
+    def __init__(self):
+        self.starts = []
+        self.ends = []
+
+    def add(self, first, count):
+        start, end = first, first + count
+        i = bisect.bisect_left(self.ends, start)
+        j = i
+        while j < len(self.starts) and self.starts[j] <= end:
+            start = min(start, self.starts[j])
+            end = max(end, self.ends[j])
+            j += 1
+        self.starts[i:j] = [start]
+        self.ends[i:j] = [end]
+
+    def remove(self, first, count):
+        start, end = first, first + count
+        i = bisect.bisect_right(self.ends, start)
+        j = i
+        pieces = []
+        while j < len(self.starts) and self.starts[j] < end:
+            if self.starts[j] < start:
+                pieces.append((self.starts[j], start))
+            if self.ends[j] > end:
+                pieces.append((end, self.ends[j]))
+            j += 1
+        self.starts[i:j] = [piece[0] for piece in pieces]
+        self.ends[i:j] = [piece[1] for piece in pieces]
+
+    def __contains__(self, value):
+        return self.range_start(value) is not None
+
+    def range_start(self, value):
+        '''The start of the range value is in, or None.'''
+        i = bisect.bisect_right(self.starts, value) - 1
+        if i >= 0 and value < self.ends[i]:
+            return self.starts[i]
+        return None
+
+    def range_end(self, value):
+        '''The end (exclusive) of the range value is in, or None.'''
+        i = bisect.bisect_right(self.starts, value) - 1
+        if i >= 0 and value < self.ends[i]:
+            return self.ends[i]
+        return None
+
+    def ranges(self):
+        return [(start, end - start) for start, end in zip(self.starts, self.ends)]
+
+    def __len__(self):
+        return sum(end - start for start, end in zip(self.starts, self.ends))
+
+
+class Journal(object):
+    '''
+    The progress of every search, read from a journal file.  Lines appended
+    by other processes are picked up by refresh().
+    '''
+
+    def __init__(self, filename):
+        self.filename = filename
+        self.offset = 0
+        self.done = {}  # Maps search ids to RangeSets
+        self.found = {}  # Maps search ids to lists of keys
+        self.exports = {}  # Maps shard ids to (search_id, first, count), until released
+        self.new_keys = []  # (search_id, key) found since the last call to pop_new_keys
+        if not os.path.exists(filename):
+            open(filename, "a").close()
+        self.refresh()
+
+    def refresh(self):
+        with open(self.filename) as f:
+            f.seek(self.offset)
+            while True:
+                line = f.readline()
+                if not line.endswith("\n"):
+                    break  # End of file, or a line still being written
+                self.offset += len(line)
+                self.apply(line.split())
+
+    def apply(self, fields):
+        if not fields:
+            return
+        if fields[0] == "done":
+            self.done.setdefault(fields[1], RangeSet()).add(int(fields[2]), int(fields[3]))
+        elif fields[0] == "redo":
+            if fields[1] in self.done:
+                self.done[fields[1]].remove(int(fields[2]), int(fields[3]))
+        elif fields[0] == "found":
+            self.found.setdefault(fields[1], []).append(fields[2])
+            self.new_keys.append((fields[1], fields[2]))
+        elif fields[0] == "export":
+            self.exports[fields[1]] = (fields[2], int(fields[3]), int(fields[4]))
+        elif fields[0] == "release":
+            self.exports.pop(fields[1], None)
+
+    def append(self, *lines):
+        '''Writes lines to the journal and applies them.'''
+        with open(self.filename, "a") as f:
+            f.write("".join(" ".join(str(field) for field in line) + "\n" for line in lines))
+        self.refresh()
+
+    def record_done(self, search_id, first, count, keys=()):
+        self.append(("done", search_id, first, count), *[("found", search_id, key) for key in keys])
+
+    def record_redo(self, search_id, first, count):
+        self.append(("redo", search_id, first, count))
+
+    def is_done(self, search_id, index):
+        return search_id in self.done and index in self.done[search_id]
+
+    def is_taken(self, search_id, index):
+        '''Whether a task is done or out in a shard.'''
+        return self.taken_start(search_id, index) is not None
+
+    def taken_start(self, search_id, index):
+        '''
+        If a task is done or out in a shard, the first task of the done range
+        or shard it's in.  Otherwise None.
+        '''
+        if search_id in self.done:
+            start = self.done[search_id].range_start(index)
+            if start is not None:
+                return start
+        for export_search, first, count in self.exports.values():
+            if export_search == search_id and first <= index < first + count:
+                return first
+        return None
+
+    def next_free(self, search_id, index):
+        '''The first task from index on that is neither done nor exported.'''
+        while True:
+            end = None
+            if search_id in self.done:
+                end = self.done[search_id].range_end(index)
+            for export_search, first, count in self.exports.values():
+                if export_search == search_id and first <= index < first + count:
+                    end = first + count
+            if end is None:
+                return index
+            index = end
+
+    def num_done(self, search_id):
+        return len(self.done.get(search_id, ()))
+
+    def pop_new_keys(self):
+        keys, self.new_keys = self.new_keys, []
+        return keys
+
+    def free_range(self, search_id, num_tasks, max_count):
+        '''
+        The highest run of at most max_count tasks that are neither done nor
+        exported, as (first, count), or None.  The manager gives out tasks
+        from the bottom, so exports from the top don't overlap with it.
+        '''
+        end = num_tasks
+        while end > 0:
+            start = self.taken_start(search_id, end - 1)
+            if start is None:
+                break
+            end = start
+        if end == 0:
+            return None
+        first = end - 1
+        while first > 0 and end - first < max_count and not self.is_taken(search_id, first - 1):
+            first -= 1
+        return first, end - first
+
+
+def keys_from_output(output):
+    '''The keys in check_keys' output.'''
+    return re.findall(r"0x[0-9a-f]{14}", output)
+
+def get_num_chunk_bits():
+    with open("input.h") as f:
+        return int(re.search(r"#define NUM_CHUNK_BITS (\d{1,2})", f.read()).group(1))
+
+
+def export_shard(journal, search_id, num_chunk_bits, num_tasks, filename=None):
+    '''
+    Exports the highest free range of up to num_tasks tasks to a shard file,
+    shard-<id>.json by default.  Returns the shard and its file name.
+    '''
+    plaintext, ciphertext, prefix = parse_search_id(search_id)
+    task_bits = 56 - num_chunk_bits - len(prefix)
+    found = journal.free_range(search_id, 2**task_bits, num_tasks)
+    if found is None:
+        raise ValueError("Every task of %s is done or exported" % search_id)
+    first, count = found
+
+    shard_id = hexlify(os.urandom(8))
+    shard = {
+        "format": SHARD_FORMAT,
+        "version": FORMAT_VERSION,
+        "shard": shard_id,
+        "created": time.strftime("%Y-%m-%d %H:%M:%S"),
+        "search": search_id,
+        "plaintext": plaintext,
+        "ciphertext": ciphertext,
+        "prefix": prefix,
+        "num_chunk_bits": num_chunk_bits,
+        "task_bits": task_bits,
+        "first": first,
+        "count": count,
+        "first_task": task_prefix(prefix, task_bits, first),
+        "last_task": task_prefix(prefix, task_bits, first + count - 1),
+    }
+    if plaintext is None:
+        shard["input_h_checksum"] = search_id.split(":")[0][len("input.h-"):]
+
+    # Journal first: if the shard file never gets written, the tasks can
+    # still be released.
+    journal.append(("export", shard_id, search_id, first, count))
+    filename = filename or "shard-%s.json" % shard_id
+    write_json(filename, shard)
+    return shard, filename
+
+def import_manifest(journal, manifest):
+    '''
+    Records a manifest's finished tasks and keys, and releases the rest of
+    its shard.  Returns the number of tasks newly marked done.
+    '''
+    shard_id = manifest["shard"]
+    if shard_id not in journal.exports:
+        raise ValueError("Shard %s was not exported with this journal, or was already imported" % shard_id)
+    search_id, first, count = journal.exports[shard_id]
+    if manifest["search"] != search_id:
+        raise ValueError("Manifest for shard %s is for a different search" % shard_id)
+
+    lines = []
+    imported = 0
+    for range_first, range_count in manifest["completed"]:
+        if range_first < first or range_first + range_count > first + count:
+            raise ValueError("Manifest for shard %s has tasks outside of the shard" % shard_id)
+        lines.append(("done", search_id, range_first, range_count))
+        imported += range_count
+    for key in manifest["keys"]:
+        lines.append(("found", search_id, key))
+    lines.append(("release", shard_id))
+    journal.append(*lines)
+    return imported
+
+
+if __name__ == "__main__":
+
+    op = OptionParser(
+        usage="%prog [options] export|import|release|status [args]",
+        description="Exports shards of a search for run_shard.py, and imports "
+        "their manifests back into the journal.  'export' writes a shard of "
+        "the search given by --job or --prefix.  'import' takes manifest "
+        "files.  'release' takes shard ids whose tasks should be given out "
+        "again, for shards that are lost.  'status' shows each search's "
+        "progress.  Run in the crack directory, since NUM_CHUNK_BITS comes "
+        "from input.h.")
+    op.add_option("--journal", type="string", dest="journal", default="journal.txt",
+        help="Journal file, shared with manager.py --journal.  Default journal.txt.")
+    op.add_option("-j", "--job", type="string", dest="job", default=None,
+        help="Export from this job, PLAINTEXT:CIPHERTEXT[:PREFIX] like "
+        "manager.py --job.  Default is the search of input.h.")
+    op.add_option("-p", "--prefix", type="string", dest="prefix", default="",
+        help="Key prefix of the input.h search, like manager.py --prefix.  "
+        "In complement mode, the default is \"0\", as it is for the manager.")
+    op.add_option("-n", "--tasks", type="int", dest="tasks", default=1024,
+        help="Most tasks to put in the shard.  Default 1024.")
+    op.add_option("-o", "--output", type="string", dest="output", default=None,
+        help="Shard file to write.  Default is shard-<id>.json.")
+    options, args = op.parse_args()
+    if not args:
+        op.error("Not enough arguments")
+    command, args = args[0], args[1:]
+
+    journal = Journal(options.journal)
+
+    if command == "export":
+        if args:
+            op.error("Too many arguments")
+        if options.job:
+            fields = options.job.lower().split(":")
+            if len(fields) not in (2, 3) or not all(re.match("^[0-9a-f]{16}$", f) for f in fields[:2]):
+                op.error("Job must be PLAINTEXT:CIPHERTEXT[:PREFIX]")
+            search_id = job_search_id(fields[0], fields[1], fields[2] if len(fields) > 2 else "")
+        else:
+            search_id = input_search_id(input_search_prefix(options.prefix))
+        if not re.match("^[01]*$", parse_search_id(search_id)[2]):
+            op.error("Prefix must be binary")
+        try:
+            shard, filename = export_shard(journal, search_id, get_num_chunk_bits(), options.tasks, options.output)
+        except ValueError as e:
+            sys.exit(str(e))
+        print "Wrote %s: %d tasks, %s to %s" % (filename, shard["count"], shard["first_task"], shard["last_task"])
+
+    elif command == "import":
+        if not args:
+            op.error("Give the manifests to import")
+        for filename in args:
+            try:
+                manifest = read_json(filename, MANIFEST_FORMAT)
+                imported = import_manifest(journal, manifest)
+            except (ValueError, KeyError) as e:
+                print "Skipping %s: %s" % (filename, e)
+                continue
+            print "Imported %s: %d tasks done, keys: %s" % (filename, imported, " ".join(manifest["keys"]) or "none")
+
+    elif command == "release":
+        for shard_id in args:
+            if shard_id not in journal.exports:
+                print "Unknown shard:", shard_id
+                continue
+            journal.append(("release", shard_id))
+            print "Released", shard_id
+
+    elif command == "status":
+        searches = set(journal.done) | set(s for s, f, c in journal.exports.values())
+        for search_id in sorted(searches):
+            print search_id
+            print "    %d tasks done, keys found: %s" % (journal.num_done(search_id), journal.found.get(search_id, []))
+            for shard_id, (export_search, first, count) in sorted(journal.exports.items()):
+                if export_search == search_id:
+                    print "    Shard %s out: tasks %d to %d" % (shard_id, first, first + count - 1)
+
+    else:
+        op.error("Unknown command: %s" % command)
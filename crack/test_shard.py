@@ -0,0 +1,101 @@
+"""
+Round trip of a shard through shard.py export and import, against the
+manager's journal.  Run from anywhere with "python test_shard.py".
+
+"""
+
+import os
+import sys
+import shutil
+import tempfile
+import unittest
+from subprocess import check_output
+
+crack_directory = os.path.dirname(os.path.realpath(__file__))
+sys.path.append(crack_directory)
+
+from manager import DesWorkManager
+from shard import MANIFEST_FORMAT, FORMAT_VERSION, read_json, write_json, \
+    task_prefix, SHARD_FORMAT
+
+# 2^6 tasks in the whole keyspace, few enough to list them all
+NUM_CHUNK_BITS = 50
+
+class ShardRoundTripTest(unittest.TestCase):
+
+    def setUp(self):
+        self.directory = tempfile.mkdtemp()
+        self.old_directory = os.getcwd()
+        os.chdir(self.directory)
+        self.journal = os.path.join(self.directory, "journal.txt")
+
+    def tearDown(self):
+        os.chdir(self.old_directory)
+        shutil.rmtree(self.directory)
+
+    def write_input_h(self, complement):
+        # Only what manager.py and shard.py read from it
+        with open("input.h", "w") as f:
+            f.write("#define NUM_CHUNK_BITS %d\n" % NUM_CHUNK_BITS)
+            if complement:
+                f.write("#define COMPLEMENT_MODE\n")
+
+    def shard_py(self, *args):
+        return check_output([sys.executable, os.path.join(crack_directory, "shard.py"),
+                             "--journal", self.journal] + list(args))
+
+    def manager(self):
+        manager = DesWorkManager("127.0.0.1", 0, journal=self.journal)
+        manager.listener.close()
+        manager.log = lambda *items, **kwargs: None
+        return manager
+
+    def round_trip(self, complement):
+        self.write_input_h(complement)
+        manager = self.manager()
+
+        self.shard_py("export", "-n", "4", "-o", "shard.json")
+        shard = read_json("shard.json", SHARD_FORMAT)
+        self.assertEqual(shard["search"], manager.search_id)
+        self.assertEqual(shard["prefix"], manager.prefix)
+        self.assertEqual(shard["count"], 4)
+        exported = set(task_prefix(shard["prefix"], shard["task_bits"], shard["first"] + i)
+                       for i in range(shard["count"]))
+
+        # What run_shard.py writes after finishing every task
+        write_json("manifest.json", {
+            "format": MANIFEST_FORMAT,
+            "version": FORMAT_VERSION,
+            "shard": shard["shard"],
+            "shard_checksum": shard["checksum"],
+            "search": shard["search"],
+            "host": "test",
+            "seconds": 0.0,
+            "completed": [[shard["first"], shard["count"]]],
+            "keys": ["0x0123456789abcd"],
+        })
+        self.shard_py("import", "manifest.json")
+
+        # A manager started afterwards hands out every other task once
+        manager = self.manager()
+        tasks = list(manager.tasks())
+        self.assertEqual(len(tasks), 2**manager.task_bits - 4)
+        self.assertEqual(len(set(tasks)), len(tasks))
+        self.assertFalse(exported & set(tasks))
+        self.assertEqual(manager.results, ["0x0123456789abcd"])
+        return manager, tasks
+
+    def test_round_trip(self):
+        manager, tasks = self.round_trip(complement=False)
+        self.assertEqual(manager.prefix, "")
+        self.assertEqual(len(tasks), 2**(56 - NUM_CHUNK_BITS) - 4)
+
+    def test_complement_mode_round_trip(self):
+        # Only the half of the keyspace starting with 0 is searched, by both
+        manager, tasks = self.round_trip(complement=True)
+        self.assertEqual(manager.prefix, "0")
+        self.assertEqual(len(tasks), 2**(55 - NUM_CHUNK_BITS) - 4)
+        self.assertTrue(all(task.startswith("0") for task in tasks))
+
+if __name__ == "__main__":
+    unittest.main()
@@ -11,6 +11,7 @@ lib_directory = os.path.realpath(os.path.join(__file__, "../../lib/"))
 sys.path.append(lib_directory)
 
 from distproc import Worker
+from autotune import read_tune_file
 
 def check_output(*popenargs, **kwargs):
     """Copied from python2.7.2 subprocess."""
@@ -31,7 +32,10 @@ class DesWorker(Worker):
 
     def do_task(self, data):
         self.log("Checking Prefix:", data)
-        return check_output(["./check_keys", data])
+
+        # Jobs send "plaintext:ciphertext:prefix", which check_keys takes as
+        # three arguments.
+        return check_output(["./check_keys"] + data.split(":"))
 
 if __name__ == "__main__":
 
@@ -41,8 +45,10 @@ if __name__ == "__main__":
     )
     op.add_option("-s", "--secret", type="string", dest="secret", default=None,
         help="Preshared secret that the manager was started with.")
-    op.add_option("-c", "--count", type="int", dest="count", default=1,
-        help="Number of workers to start.  Default 1.")
+    op.add_option("-c", "--count", type="int", dest="count",
+        default=int(read_tune_file().get("THREADS", 1)),
+        help="Number of workers to start.  Default is the thread count "
+        "autotune.py found fastest, or 1.")
 
     options, args = op.parse_args()
     if len(args) > 1:
@@ -0,0 +1,344 @@
+/*
+ * Dictionary attack on traditional Unix crypt(3) password hashes.
+ *
+ * crypt(3) uses the first 8 characters of the password, shifted left one
+ * bit, as a DES key, and encrypts a block of zeros 25 times in a row.  A 12
+ * bit salt perturbs the expansion so that precomputed tables and hardware
+ * DES don't work.  The hash is the 2 character salt followed by the 64 bit
+ * result in 11 characters, 6 bits each.
+ *
+ * Candidate passwords are checked 64 at a time using the bitsliced
+ * encryption in des_64.h.  The salt only renames expansion outputs, so every
+ * salt gets its own copy of feistel_input_orders instead of slowing down the
+ * rounds.  Hashes are grouped by salt, so each batch of 64 passwords is only
+ * encrypted once per distinct salt, then compared with every hash using it.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "des_64.h"  // des_encrypt_salted, salt_input_orders, zip_64_bit
+
+#define HASH_LENGTH 13
+#define ITERATIONS 25
+#define MAX_LINE 1024
+
+static const char ALPHABET[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+struct hash {
+    char* name;  // User name, or the hash itself if there isn't one
+    char text[HASH_LENGTH+1];
+    unsigned int salt;
+    uint64_t result_zipped[64];
+    int cracked;
+};
+
+// Hashes that share a salt, which are consecutive in the hashes array
+struct salt_group {
+    unsigned int salt;
+    unsigned char input_orders[2][48];
+    int first;
+    int count;
+};
+
+struct attack {
+    struct hash* hashes;
+    int num_hashes;
+    struct salt_group* groups;
+    int num_groups;
+
+    FILE* wordlist;
+    uint64_t num_words;
+    int num_cracked;
+    pthread_mutex_t lock;
+};
+
+
+/***** Hashes *****/
+
+static int decode_char(char c) {
+    const char* position = strchr(ALPHABET, c);
+    return c && position ? position - ALPHABET : -1;
+}
+
+/*
+ * Parses a 13 character hash.  Returns -1 if it isn't one.
+ */
+static int parse_hash(const char* text, struct hash* hash) {
+    int values[HASH_LENGTH];
+    if (strlen(text) != HASH_LENGTH) {
+        return -1;
+    }
+    for (int i=0; i<HASH_LENGTH; i++) {
+        values[i] = decode_char(text[i]);
+        if (values[i] < 0) {
+            return -1;
+        }
+    }
+
+    strcpy(hash->text, text);
+    hash->salt = values[0] | values[1] << 6;
+
+    // 11 characters hold 66 bits.  The last 2 are always 0.
+    uint64_t result = 0;
+    for (int i=2; i<HASH_LENGTH-1; i++) {
+        result = result << 6 | values[i];
+    }
+    result = result << 4 | values[HASH_LENGTH-1] >> 2;
+
+    for (int i=0; i<64; i++) {
+        hash->result_zipped[i] = (result >> (63-i)) & 1 ? 0xffffffffffffffffLL : 0;
+    }
+    hash->cracked = 0;
+    return 0;
+}
+
+static int compare_salts(const void* a, const void* b) {
+    unsigned int salt_a = ((const struct hash*) a)->salt;
+    unsigned int salt_b = ((const struct hash*) b)->salt;
+    return (salt_a > salt_b) - (salt_a < salt_b);
+}
+
+/*
+ * Reads hashes, one per line, either alone or in passwd format
+ * ("user:hash:...").  Lines without a valid hash are skipped.
+ */
+static int read_hashes(const char* filename, struct attack* attack) {
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "Could not open \"%s\"\n", filename);
+        return -1;
+    }
+
+    char line[MAX_LINE];
+    int capacity = 64;
+    int skipped = 0;
+    attack->hashes = malloc(capacity * sizeof(struct hash));
+    attack->num_hashes = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        char* name = line;
+        char* text = line;
+        char* colon = strchr(line, ':');
+        if (colon) {
+            *colon = '\0';
+            text = colon + 1;
+            text[strcspn(text, ":")] = '\0';
+        }
+
+        if (attack->num_hashes == capacity) {
+            capacity *= 2;
+            attack->hashes = realloc(attack->hashes, capacity * sizeof(struct hash));
+        }
+        struct hash* hash = &attack->hashes[attack->num_hashes];
+        if (parse_hash(text, hash)) {
+            skipped++;
+            continue;
+        }
+        hash->name = strdup(name);
+        attack->num_hashes++;
+    }
+    fclose(f);
+
+    if (skipped) {
+        fprintf(stderr, "Skipped %d lines without a crypt(3) hash\n", skipped);
+    }
+    if (attack->num_hashes == 0) {
+        fprintf(stderr, "No hashes in \"%s\"\n", filename);
+        return -1;
+    }
+
+    // Group by salt
+    qsort(attack->hashes, attack->num_hashes, sizeof(struct hash), compare_salts);
+    attack->groups = malloc(attack->num_hashes * sizeof(struct salt_group));
+    attack->num_groups = 0;
+    for (int i=0; i<attack->num_hashes; i++) {
+        if (i == 0 || attack->hashes[i].salt != attack->hashes[i-1].salt) {
+            struct salt_group* group = &attack->groups[attack->num_groups++];
+            group->salt = attack->hashes[i].salt;
+            salt_input_orders(group->salt, group->input_orders);
+            group->first = i;
+            group->count = 0;
+        }
+        attack->groups[attack->num_groups-1].count++;
+    }
+    return 0;
+}
+
+
+/***** Cracking *****/
+
+/*
+ * Reads up to 64 passwords.  Only the first 8 characters matter.  Returns
+ * the number read.
+ */
+static int read_words(struct attack* attack, char words[64][9]) {
+    char line[MAX_LINE];
+    int n = 0;
+
+    pthread_mutex_lock(&attack->lock);
+    while (n < 64 && attack->num_cracked < attack->num_hashes &&
+            fgets(line, sizeof(line), attack->wordlist)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        strncpy(words[n], line, 8);
+        words[n][8] = '\0';
+        n++;
+    }
+    attack->num_words += n;
+    pthread_mutex_unlock(&attack->lock);
+
+    return n;
+}
+
+/*
+ * The key is the 7 bit characters of the password, each shifted left one
+ * bit, so the (unused) parity bit is last.
+ */
+static void make_keys(char words[64][9], int n, uint64_t key_bits[64]) {
+    uint64_t keys[64] = {0};
+    for (int i=0; i<n; i++) {
+        for (int j=0; j<8 && words[i][j]; j++) {
+            keys[i] |= (uint64_t) ((words[i][j] & 0x7f) << 1) << (56 - j*8);
+        }
+    }
+    zip_64_bit(keys, key_bits);
+}
+
+/*
+ * Compares two zipped inputs.  Return a uint64_t in which each 0 represents a
+ * match for that position.
+ */
+static uint64_t compare(const uint64_t a[64], const uint64_t b[64]) {
+    uint64_t result = 0LL;
+    for (int i=0; i<64; i++) {
+        result |= a[i] ^ b[i];
+        if (result == 0xffffffffffffffffLL) {
+            return result;
+        }
+    }
+    return result;
+}
+
+static void* crack_thread(void* arg) {
+    struct attack* attack = arg;
+    char words[64][9];
+    uint64_t key_bits[64];
+    uint64_t block[64];
+    int n;
+
+    while ((n = read_words(attack, words)) > 0) {
+        make_keys(words, n, key_bits);
+
+        for (int g=0; g<attack->num_groups; g++) {
+            const struct salt_group* group = &attack->groups[g];
+
+            memset(block, 0, 64*8);
+            for (int i=0; i<ITERATIONS; i++) {
+                des_encrypt_salted(block, key_bits, (const unsigned char (*)[48]) group->input_orders);
+            }
+
+            for (int h=group->first; h<group->first+group->count; h++) {
+                struct hash* hash = &attack->hashes[h];
+                uint64_t comparison = compare(block, hash->result_zipped);
+                for (int lane=0; lane<n; lane++) {
+                    if (comparison & (0x8000000000000000LL >> lane)) {
+                        continue;
+                    }
+                    pthread_mutex_lock(&attack->lock);
+                    if (!hash->cracked) {
+                        hash->cracked = 1;
+                        attack->num_cracked++;
+                        printf("%s:%s\n", hash->name, words[lane]);
+                        fflush(stdout);
+                    }
+                    pthread_mutex_unlock(&attack->lock);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/***** Main *****/
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: crypt3 [options] <hash_file> [<wordlist>]\n"
+        "\n"
+        "Tries every password in wordlist (or standard input) against the\n"
+        "traditional crypt(3) hashes in hash_file.  Hashes are given one per line,\n"
+        "alone or in passwd format.  Cracked passwords are printed as\n"
+        "\"user:password\", or \"hash:password\" without a user name.\n"
+        "\n"
+        "Options:\n"
+        "  -t THREADS  Number of threads.  Default is the number of cores.\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    struct attack attack;
+    memset(&attack, 0, sizeof(attack));
+    pthread_mutex_init(&attack.lock, NULL);
+
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "t:h")) != -1) {
+        switch (opt) {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    argv += optind;
+    argc -= optind;
+    if (argc < 1 || argc > 2 || num_threads < 1) {
+        usage();
+    }
+
+    if (read_hashes(argv[0], &attack)) {
+        return 1;
+    }
+    attack.wordlist = argc > 1 ? fopen(argv[1], "r") : stdin;
+    if (!attack.wordlist) {
+        fprintf(stderr, "Could not open \"%s\"\n", argv[1]);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    for (int i=0; i<num_threads; i++) {
+        pthread_create(&threads[i], NULL, crack_thread, &attack);
+    }
+    for (int i=0; i<num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Cracked %d of %d hashes (%d salts).  %lu passwords in %.1f seconds",
+            attack.num_cracked, attack.num_hashes, attack.num_groups, attack.num_words, seconds);
+    if (seconds > 0) {
+        fprintf(stderr, ", %.0f crypts/second", attack.num_words * (double) attack.num_groups / seconds);
+    }
+    fprintf(stderr, "\n");
+
+    return attack.num_cracked ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/*
+ * The word type the bitsliced code is written against.
+ *
+ * Each bs_t holds one bit of BS_WIDTH independent blocks (or keys), one per
+ * lane.  sbox.h and des_64.h only ever use &, |, ^ and ~ on it, so the same
+ * source works for any width:
+ *
+ *   BS_WIDTH=64   uint64_t (default)
+ *   BS_WIDTH=128  SSE2 / NEON
+ *   BS_WIDTH=256  AVX2
+ *   BS_WIDTH=512  AVX-512
+ *
+ * Wider types use the GCC/Clang vector extension, which turns the operators
+ * into the matching vector instructions, or pairs of narrower ones if the
+ * target doesn't have them.  Build with the instruction set enabled (for
+ * example "-mavx2" with BS_WIDTH=256), or the vectors are split up again.
+ *
+ * Lane l is bit 63-(l%64) of 64 bit word l/64, so at BS_WIDTH=64 lanes are
+ * numbered exactly as they are in a uint64_t.
+ *
+ */
+
+#ifndef BITSLICE_H
+#define BITSLICE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef BS_WIDTH
+#define BS_WIDTH 64
+#endif
+
+// Number of 64 bit words in a bs_t
+#define BS_WORDS (BS_WIDTH / 64)
+
+// log2(BS_WIDTH), the number of bits needed to number the lanes
+#if BS_WIDTH == 64
+#define BS_WIDTH_BITS 6
+#elif BS_WIDTH == 128
+#define BS_WIDTH_BITS 7
+#elif BS_WIDTH == 256
+#define BS_WIDTH_BITS 8
+#elif BS_WIDTH == 512
+#define BS_WIDTH_BITS 9
+#else
+#error "BS_WIDTH must be 64, 128, 256 or 512"
+#endif
+
+#if BS_WIDTH == 64
+typedef uint64_t bs_t;
+#else
+#if !defined(__GNUC__)
+#error "BS_WIDTH above 64 needs the GCC/Clang vector extension"
+#endif
+typedef uint64_t bs_t __attribute__ ((vector_size (BS_WIDTH / 8)));
+#endif
+
+#define BS_ZERO ((bs_t) {0})
+#define BS_ONES (~BS_ZERO)
+
+// Every lane set to the same 64 bit word.  Used on words that are all 0s or
+// all 1s, like the preprocessed plaintext and ciphertext in input.h.
+#define bs_broadcast(word) (BS_ZERO + (uint64_t) (word))
+
+static inline uint64_t bs_get_word(bs_t x, int word) {
+    uint64_t words[BS_WORDS];
+    memcpy(words, &x, sizeof(x));
+    return words[word];
+}
+
+static inline void bs_set_word(bs_t* x, int word, uint64_t value) {
+    memcpy((char*) x + word*8, &value, 8);
+}
+
+// Every lane of x is set
+static inline int bs_all_ones(bs_t x) {
+    uint64_t result = 0xffffffffffffffffLL;
+    for (int i=0; i<BS_WORDS; i++) {
+        result &= bs_get_word(x, i);
+    }
+    return result == 0xffffffffffffffffLL;
+}
+
+/*
+ * Like zip_64_bit, but for BS_WIDTH inputs: bit i of input[lane] becomes
+ * lane lane of output[i].  Each group of 64 inputs is transposed into one
+ * word of the outputs.
+ */
+static inline void bs_zip(const uint64_t input[BS_WIDTH], bs_t output[64]) {
+    for (int i=0; i<64; i++) {
+        output[i] = BS_ZERO;
+    }
+    for (int word=0; word<BS_WORDS; word++) {
+        for (int i=0; i<64; i++) {
+            uint64_t slice = 0;
+            for (int lane=0; lane<64; lane++) {
+                slice |= ((input[word*64 + lane] >> (63-i)) & 1) << (63-lane);
+            }
+            bs_set_word(&output[i], word, slice);
+        }
+    }
+}
+
+// The inverse of bs_zip
+static inline void bs_unzip(const bs_t input[64], uint64_t output[BS_WIDTH]) {
+    memset(output, 0, BS_WIDTH*8);
+    for (int word=0; word<BS_WORDS; word++) {
+        for (int i=0; i<64; i++) {
+            uint64_t slice = bs_get_word(input[i], word);
+            for (int lane=0; lane<64; lane++) {
+                output[word*64 + lane] |= ((slice >> (63-lane)) & 1) << (63-i);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * The bitsliced DES encryption from des_64.c, for use in other programs.
+ * BS_WIDTH encryptions (or decryptions) are done at once, each with its own
+ * key, on blocks and keys in zipped format (see zip_64_bit, or bs_zip for
+ * widths other than 64).  The rounds are written against bs_t, which is a
+ * uint64_t unless BS_WIDTH is set (see bitslice.h).
+ *
+ * Permutations are not done in memory.  Instead, the tables below index the
+ * bit that would have been used if they were.
+ *
+ */
+
+#ifndef DES_64_H
+#define DES_64_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bitslice.h"  // bs_t
+#include "sbox.h"  // s-boxes: s0 to s7
+
+static const unsigned char left_block_order[32] = {
+    57, 49, 41, 33, 25, 17,  9, 1,
+    59, 51, 43, 35, 27, 19, 11, 3,
+    61, 53, 45, 37, 29, 21, 13, 5,
+    63, 55, 47, 39, 31, 23, 15, 7
+};
+static const unsigned char right_block_order[32] = {
+    56, 48, 40, 32, 24, 16,  8, 0,
+    58, 50, 42, 34, 26, 18, 10, 2,
+    60, 52, 44, 36, 28, 20, 12, 4,
+    62, 54, 46, 38, 30, 22, 14, 6
+};
+static const unsigned char encrypt_output_order[64] = {
+    // Right block order
+    56, 48, 40, 32, 24, 16,  8, 0,
+    58, 50, 42, 34, 26, 18, 10, 2,
+    60, 52, 44, 36, 28, 20, 12, 4,
+    62, 54, 46, 38, 30, 22, 14, 6,
+
+    // Left block order
+    57, 49, 41, 33, 25, 17,  9, 1,
+    59, 51, 43, 35, 27, 19, 11, 3,
+    61, 53, 45, 37, 29, 21, 13, 5,
+    63, 55, 47, 39, 31, 23, 15, 7
+};
+
+static const unsigned char feistel_input_orders[2][48] = {
+    {
+         6, 56, 48, 40, 32, 24,
+        32, 24, 16,  8,  0, 58,
+         0, 58, 50, 42, 34, 26,
+        34, 26, 18, 10,  2, 60,
+         2, 60, 52, 44, 36, 28,
+        36, 28, 20, 12,  4, 62,
+         4, 62, 54, 46, 38, 30,
+        38, 30, 22, 14,  6, 56
+    },
+    {
+         7, 57, 49, 41, 33, 25,
+        33, 25, 17,  9,  1, 59,
+         1, 59, 51, 43, 35, 27,
+        35, 27, 19, 11,  3, 61,
+         3, 61, 53, 45, 37, 29,
+        37, 29, 21, 13,  5, 63,
+         5, 63, 55, 47, 39, 31,
+        39, 31, 23, 15,  7, 57
+    },
+};
+
+static const unsigned char feistel_output_order[32] = {
+     8, 16, 22, 30, 12, 27,  1, 17,
+    23, 15, 29,  5, 25, 19,  9,  0,
+     7, 13, 24,  2,  3, 28, 10, 18,
+    31, 11, 21,  6,  4, 26, 14, 20
+};
+
+/*
+ * Each of these 16 arrays represents which bits from the key make up the ith
+ * subkey.
+ */
+static const unsigned char key_bit_orders[16][48] = {
+    { // Subkey 0
+         9, 50, 33, 59, 48, 16,
+        32, 56,  1,  8, 18, 41,
+         2, 34, 25, 24, 43, 57,
+        58,  0, 35, 26, 17, 40,
+        21, 27, 38, 53, 36,  3,
+        46, 29,  4, 52, 22, 28,
+        60, 20, 37, 62, 14, 19,
+        44, 13, 12, 61, 54, 30
+    },
+    { // Subkey 1
+         1, 42, 25, 51, 40,  8,
+        24, 48, 58,  0, 10, 33,
+        59, 26, 17, 16, 35, 49,
+        50, 57, 56, 18,  9, 32,
+        13, 19, 30, 45, 28, 62,
+        38, 21, 27, 44, 14, 20,
+        52, 12, 29, 54,  6, 11,
+        36,  5,  4, 53, 46, 22
+    },
+    { // Subkey 2
+        50, 26,  9, 35, 24, 57,
+         8, 32, 42, 49, 59, 17,
+        43, 10,  1,  0, 48, 33,
+        34, 41, 40,  2, 58, 16,
+        60,  3, 14, 29, 12, 46,
+        22,  5, 11, 28, 61,  4,
+        36, 27, 13, 38, 53, 62,
+        20, 52, 19, 37, 30, 6
+    },
+    { // Subkey 3
+        34, 10, 58, 48,  8, 41,
+        57, 16, 26, 33, 43,  1,
+        56, 59, 50, 49, 32, 17,
+        18, 25, 24, 51, 42,  0,
+        44, 54, 61, 13, 27, 30,
+         6, 52, 62, 12, 45, 19,
+        20, 11, 60, 22, 37, 46,
+         4, 36,  3, 21, 14, 53
+    },
+    { // Subkey 4
+        18, 59, 42, 32, 57, 25,
+        41,  0, 10, 17, 56, 50,
+        40, 43, 34, 33, 16,  1,
+         2,  9,  8, 35, 26, 49,
+        28, 38, 45, 60, 11, 14,
+        53, 36, 46, 27, 29,  3,
+         4, 62, 44,  6, 21, 30,
+        19, 20, 54,  5, 61, 37
+    },
+    { // Subkey 5
+         2, 43, 26, 16, 41,  9,
+        25, 49, 59,  1, 40, 34,
+        24, 56, 18, 17,  0, 50,
+        51, 58, 57, 48, 10, 33,
+        12, 22, 29, 44, 62, 61,
+        37, 20, 30, 11, 13, 54,
+        19, 46, 28, 53,  5, 14,
+         3,  4, 38, 52, 45, 21
+    },
+    { // Subkey 6
+        51, 56, 10,  0, 25, 58,
+         9, 33, 43, 50, 24, 18,
+         8, 40,  2,  1, 49, 34,
+        35, 42, 41, 32, 59, 17,
+        27,  6, 13, 28, 46, 45,
+        21,  4, 14, 62, 60, 38,
+         3, 30, 12, 37, 52, 61,
+        54, 19, 22, 36, 29,  5
+    },
+    { // Subkey 7
+        35, 40, 59, 49,  9, 42,
+        58, 17, 56, 34,  8,  2,
+        57, 24, 51, 50, 33, 18,
+        48, 26, 25, 16, 43,  1,
+        11, 53, 60, 12, 30, 29,
+         5, 19, 61, 46, 44, 22,
+        54, 14, 27, 21, 36, 45,
+        38,  3,  6, 20, 13, 52
+    },
+    { // Subkey 8
+        56, 32, 51, 41,  1, 34,
+        50,  9, 48, 26,  0, 59,
+        49, 16, 43, 42, 25, 10,
+        40, 18, 17,  8, 35, 58,
+         3, 45, 52,  4, 22, 21,
+        60, 11, 53, 38, 36, 14,
+        46,  6, 19, 13, 28, 37,
+        30, 62, 61, 12,  5, 44
+    },
+    { // Subkey 9
+        40, 16, 35, 25, 50, 18,
+        34, 58, 32, 10, 49, 43,
+        33,  0, 56, 26,  9, 59,
+        24,  2,  1, 57, 48, 42,
+        54, 29, 36, 19,  6,  5,
+        44, 62, 37, 22, 20, 61,
+        30, 53,  3, 60, 12, 21,
+        14, 46, 45, 27, 52, 28
+    },
+    { // Subkey 10
+        24,  0, 48,  9, 34,  2,
+        18, 42, 16, 59, 33, 56,
+        17, 49, 40, 10, 58, 43,
+         8, 51, 50, 41, 32, 26,
+        38, 13, 20,  3, 53, 52,
+        28, 46, 21,  6,  4, 45,
+        14, 37, 54, 44, 27,  5,
+        61, 30, 29, 11, 36, 12
+    },
+    { // Subkey 11
+         8, 49, 32, 58, 18, 51,
+         2, 26,  0, 43, 17, 40,
+         1, 33, 24, 59, 42, 56,
+        57, 35, 34, 25, 16, 10,
+        22, 60,  4, 54, 37, 36,
+        12, 30,  5, 53, 19, 29,
+        61, 21, 38, 28, 11, 52,
+        45, 14, 13, 62, 20, 27
+    },
+    { // Subkey 12
+        57, 33, 16, 42,  2, 35,
+        51, 10, 49, 56,  1, 24,
+        50, 17,  8, 43, 26, 40,
+        41, 48, 18,  9,  0, 59,
+         6, 44, 19, 38, 21, 20,
+        27, 14, 52, 37,  3, 13,
+        45,  5, 22, 12, 62, 36,
+        29, 61, 60, 46,  4, 11
+    },
+    { // Subkey 13
+        41, 17,  0, 26, 51, 48,
+        35, 59, 33, 40, 50,  8,
+        34,  1, 57, 56, 10, 24,
+        25, 32,  2, 58, 49, 43,
+        53, 28,  3, 22,  5,  4,
+        11, 61, 36, 21, 54, 60,
+        29, 52,  6, 27, 46, 20,
+        13, 45, 44, 30, 19, 62
+    },
+    { // Subkey 14
+        25,  1, 49, 10, 35, 32,
+        48, 43, 17, 24, 34, 57,
+        18, 50, 41, 40, 59,  8,
+         9, 16, 51, 42, 33, 56,
+        37, 12, 54,  6, 52, 19,
+        62, 45, 20,  5, 38, 44,
+        13, 36, 53, 11, 30,  4,
+        60, 29, 28, 14,  3, 46
+    },
+    { // Subkey 15
+        17, 58, 41,  2, 56, 24,
+        40, 35,  9, 16, 26, 49,
+        10, 42, 33, 32, 51,  0,
+         1,  8, 43, 34, 25, 48,
+        29,  4, 46, 61, 44, 11,
+        54, 37, 12, 60, 30, 36,
+         5, 28, 45,  3, 22, 27,
+        52, 21, 20,  6, 62, 38
+    }
+};
+
+static const unsigned char final_permutation[64] = {
+    39, 7, 47, 15, 55, 23, 63, 31,
+    38, 6, 46, 14, 54, 22, 62, 30,
+    37, 5, 45, 13, 53, 21, 61, 29,
+    36, 4, 44, 12, 52, 20, 60, 28,
+    35, 3, 43, 11, 51, 19, 59, 27,
+    34, 2, 42, 10, 50, 18, 58, 26,
+    33, 1, 41,  9, 49, 17, 57, 25,
+    32, 0, 40,  8, 48, 16, 56, 24
+};
+
+/*
+ * Take 64 integers of length 64 and put the ith bit of input[j] into
+ * the jth bit of output[i].  Think of this as writing every single bit
+ * into a 64x64 matrix, then transposing that matrix.  Consequently,
+ * function is its own inverse.
+ *
+ * Done recursively like crack/check_keys.h: swap the top right and bottom
+ * left 32x32 blocks, then the same inside every 32x32 block at once, and so
+ * on down to single bits.
+ */
+static void zip_64_bit(const uint64_t input[64], uint64_t output[64]) {
+    uint64_t mask = 0x00000000ffffffffLL;
+    memcpy(output, input, 64*8);
+    for (int width=32; width; width >>= 1, mask ^= mask << width) {
+        for (int i=0; i<64; i = (i + width + 1) & ~width) {
+            uint64_t swap = (output[i] ^ (output[i+width] >> width)) & mask;
+            output[i] ^= swap;
+            output[i+width] ^= swap << width;
+        }
+    }
+}
+
+// Sets each of the n slices to all 0s or all 1s, according to value's bits
+static void set_constant_slices(uint64_t* slices, int n, uint64_t value) {
+    for (int i=0; i<n; i++) {
+        slices[i] = (value >> (n-1-i)) & 1 ? 0xffffffffffffffffLL : 0;
+    }
+}
+
+/*
+ * Macros for one round, shared by des_crypt and des_round.  They use the
+ * block_bits, key_bits and input_orders of the function they're expanded in.
+ *
+ * Each sbox reads its inputs straight out of block_bits through the
+ * expansion and subkey tables, and XORs its outputs straight into the other
+ * half, so there is no temp array and, once the tables are folded into the
+ * indexes, no table lookups either.  That folding happens when roundnum,
+ * key_round and input_orders are all constants.
+ *
+ * The halves are never switched, instead the half that is used alternates
+ * each round (left_block_order and right_block_order).
+ */
+
+// Input i of sbox snum: the expanded bit XOR bit i of subkey key_round
+#define DES_INPUT(roundnum, key_round, snum, i) ( \
+    block_bits[input_orders[(roundnum)%2][snum*6 + i]] ^ \
+    key_bits[key_bit_orders[key_round][snum*6 + i]] \
+)
+
+// Where output i of sbox snum is XORed into: the half not used as input
+#define DES_OUTPUT(roundnum, snum, i) ( \
+    block_bits[((roundnum)%2 ? right_block_order : left_block_order)[feistel_output_order[snum*4 + i]]] \
+)
+
+#define DES_SBOX(roundnum, key_round, snum) { \
+    bs_t out1, out2, out3, out4; \
+    s ## snum ( \
+        DES_INPUT(roundnum, key_round, snum, 0), \
+        DES_INPUT(roundnum, key_round, snum, 1), \
+        DES_INPUT(roundnum, key_round, snum, 2), \
+        DES_INPUT(roundnum, key_round, snum, 3), \
+        DES_INPUT(roundnum, key_round, snum, 4), \
+        DES_INPUT(roundnum, key_round, snum, 5), \
+        &out1, &out2, &out3, &out4 \
+    ); \
+    DES_OUTPUT(roundnum, snum, 0) ^= out1; \
+    DES_OUTPUT(roundnum, snum, 1) ^= out2; \
+    DES_OUTPUT(roundnum, snum, 2) ^= out3; \
+    DES_OUTPUT(roundnum, snum, 3) ^= out4; \
+}
+
+#define DES_ROUND(roundnum, key_round) \
+    DES_SBOX(roundnum, key_round, 0) \
+    DES_SBOX(roundnum, key_round, 1) \
+    DES_SBOX(roundnum, key_round, 2) \
+    DES_SBOX(roundnum, key_round, 3) \
+    DES_SBOX(roundnum, key_round, 4) \
+    DES_SBOX(roundnum, key_round, 5) \
+    DES_SBOX(roundnum, key_round, 6) \
+    DES_SBOX(roundnum, key_round, 7)
+
+/*
+ * Does all 16 rounds and the final permutation, in place.
+ *
+ * The rounds are written out, so every round number is a constant.  With
+ * decrypt and input_orders constant too, which is the case for des_encrypt
+ * and des_decrypt, every table lookup is folded away.  des_encrypt_salted
+ * passes tables built at run time, and pays for the lookups.
+ */
+inline static void des_crypt(bs_t block_bits[64], const bs_t key_bits[64], const int decrypt, const unsigned char input_orders[2][48]) {
+
+    // Decryption is the same, with the subkeys used in reverse order
+    #define ROUND(roundnum) DES_ROUND(roundnum, decrypt ? 15-roundnum : roundnum)
+
+    ROUND(0);
+    ROUND(1);
+    ROUND(2);
+    ROUND(3);
+    ROUND(4);
+    ROUND(5);
+    ROUND(6);
+    ROUND(7);
+    ROUND(8);
+    ROUND(9);
+    ROUND(10);
+    ROUND(11);
+    ROUND(12);
+    ROUND(13);
+    ROUND(14);
+    ROUND(15);
+
+    #undef ROUND
+
+    // Unswitch block halves and permute results back into block_bits
+    bs_t final_block[64];
+    for (int i=0; i<64; i++) {
+        final_block[i] = block_bits[encrypt_output_order[final_permutation[i]]];
+    }
+    memcpy(block_bits, final_block, sizeof(final_block));
+
+}
+
+/*
+ * A single encryption round, for looking at the state between rounds.
+ *
+ * Unlike des_encrypt, there is no initial or final permutation and the
+ * halves stay where des_crypt keeps them: before round 0, L0 is in the
+ * block_bits given by left_block_order and R0 in right_block_order (which is
+ * where the initial permutation would have put them).  After an even number
+ * of rounds they are in the same place, after an odd number they are
+ * swapped.
+ */
+static void des_round(bs_t block_bits[64], const bs_t key_bits[64], const int roundnum) {
+    const unsigned char (*input_orders)[48] = feistel_input_orders;
+
+    // A case per round, so the tables are still folded away
+    #define CASE(roundnum) case roundnum: DES_ROUND(roundnum, roundnum); break;
+
+    switch (roundnum) {
+        CASE(0);
+        CASE(1);
+        CASE(2);
+        CASE(3);
+        CASE(4);
+        CASE(5);
+        CASE(6);
+        CASE(7);
+        CASE(8);
+        CASE(9);
+        CASE(10);
+        CASE(11);
+        CASE(12);
+        CASE(13);
+        CASE(14);
+        CASE(15);
+    }
+
+    #undef CASE
+}
+
+static void des_encrypt(bs_t block_bits[64], const bs_t key_bits[64]) {
+    des_crypt(block_bits, key_bits, 0, feistel_input_orders);
+}
+
+static void des_decrypt(bs_t block_bits[64], const bs_t key_bits[64]) {
+    des_crypt(block_bits, key_bits, 1, feistel_input_orders);
+}
+
+/*
+ * Traditional crypt(3) perturbs the expansion with a 12 bit salt: for every
+ * salt bit i that is set, expansion outputs i and i+24 are swapped.  Since
+ * the expansion is only a renaming, this just swaps entries of
+ * feistel_input_orders.  Pass the result to des_encrypt_salted.
+ */
+static void salt_input_orders(unsigned int salt, unsigned char input_orders[2][48]) {
+    memcpy(input_orders, feistel_input_orders, 2*48);
+    for (int i=0; i<12; i++) {
+        if (salt >> i & 1) {
+            for (int half=0; half<2; half++) {
+                unsigned char temp = input_orders[half][i];
+                input_orders[half][i] = input_orders[half][i+24];
+                input_orders[half][i+24] = temp;
+            }
+        }
+    }
+}
+
+static void des_encrypt_salted(bs_t block_bits[64], const bs_t key_bits[64], const unsigned char input_orders[2][48]) {
+    des_crypt(block_bits, key_bits, 0, input_orders);
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Command line number parsing shared by the programs in this repository.
+ *
+ * Each program defines its own usage(), which prints its help and exits.
+ * These call it for anything that isn't entirely a number.
+ *
+ */
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static void usage();
+
+// A number in the given base, as strtoull takes it (0 allows a 0x prefix)
+static uint64_t parse_number(const char* string, int base) {
+    char* end;
+    uint64_t value = strtoull(string, &end, base);
+    if (*string == '\0' || *end != '\0') {
+        usage();
+    }
+    return value;
+}
+
+// Up to max_digits hex digits
+static uint64_t parse_hex(const char* string, int max_digits) {
+    char* end;
+    uint64_t value = strtoull(string, &end, 16);
+    if (end == string || *end != '\0' || end - string > max_digits) {
+        usage();
+    }
+    return value;
+}
+
+#endif
@@ -5,27 +5,32 @@
  * John The Ripper has implementations with less gates.  See:
  *     http://www.openwall.com/lists/john-users/2011/06/22/1
  *
+ * The gates are written against bs_t (see bitslice.h), so the same functions
+ * compute BS_WIDTH sboxes at once at any width.
+ *
  */
 
+#include "bitslice.h"  // bs_t
+
 static inline void s0(
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50, x51, x52, x53, x54, x55, x56;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50, x51, x52, x53, x54, x55, x56;
 
     x1 = a3 & ~a5;
     x2 = x1 ^ a4;
@@ -90,24 +95,24 @@ static inline void s0(
 }
 
 static inline void s1(
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50;
 
     x1 = a1 ^ a6;
     x2 = x1 ^ a5;
@@ -166,24 +171,24 @@ static inline void s1(
 }
 
 static inline void s2 (
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50, x51, x52, x53;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50, x51, x52, x53;
 
     x1 = a2 ^ a3;
     x2 = x1 ^ a6;
@@ -245,22 +250,22 @@ static inline void s2 (
 }
 
 static inline void s3 (
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39;
 
     x1 = a1 | a3;
     x2 = a5 & x1;
@@ -308,24 +313,24 @@ static inline void s3 (
 }
 
 static inline void s4 (
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50, x51, x52, x53, x54, x55, x56;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50, x51, x52, x53, x54, x55, x56;
 
     x1 = a3 & ~a4;
     x2 = x1 ^ a1;
@@ -390,24 +395,24 @@ static inline void s4 (
 }
 
 static inline void s5 (
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50, x51, x52, x53;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50, x51, x52, x53;
 
     x1 = a5 ^ a1;
     x2 = x1 ^ a6;
@@ -469,24 +474,24 @@ static inline void s5 (
 }
 
 static inline void s6 (
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50, x51;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50, x51;
 
     x1 = a2 & a4;
     x2 = x1 ^ a5;
@@ -546,24 +551,24 @@ static inline void s6 (
 }
 
 static inline void s7 (
-    const uint64_t a1,
-    const uint64_t a2,
-    const uint64_t a3,
-    const uint64_t a4,
-    const uint64_t a5,
-    const uint64_t a6,
-    uint64_t *out1,
-    uint64_t *out2,
-    uint64_t *out3,
-    uint64_t *out4
+    const bs_t a1,
+    const bs_t a2,
+    const bs_t a3,
+    const bs_t a4,
+    const bs_t a5,
+    const bs_t a6,
+    bs_t *out1,
+    bs_t *out2,
+    bs_t *out3,
+    bs_t *out4
 ) {
-    uint64_t x1, x2, x3, x4, x5, x6, x7, x8;
-    uint64_t x9, x10, x11, x12, x13, x14, x15, x16;
-    uint64_t x17, x18, x19, x20, x21, x22, x23, x24;
-    uint64_t x25, x26, x27, x28, x29, x30, x31, x32;
-    uint64_t x33, x34, x35, x36, x37, x38, x39, x40;
-    uint64_t x41, x42, x43, x44, x45, x46, x47, x48;
-    uint64_t x49, x50;
+    bs_t x1, x2, x3, x4, x5, x6, x7, x8;
+    bs_t x9, x10, x11, x12, x13, x14, x15, x16;
+    bs_t x17, x18, x19, x20, x21, x22, x23, x24;
+    bs_t x25, x26, x27, x28, x29, x30, x31, x32;
+    bs_t x33, x34, x35, x36, x37, x38, x39, x40;
+    bs_t x41, x42, x43, x44, x45, x46, x47, x48;
+    bs_t x49, x50;
 
     x1 = a3 ^ a1;
     x2 = a1 & ~a3;
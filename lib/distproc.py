@@ -1,13 +1,25 @@
 
 import socket
-from select import select
-from collections import defaultdict
+from time import time
+from random import random
+from select import poll, POLLIN
+from collections import defaultdict, deque
 from multiprocessing import AuthenticationError
 from multiprocessing.connection import Listener, Client
 
+from metrics import WorkMetrics, MetricsServer
+
+# Most connections to accept in one pass of the main loop, so results keep
+# being processed while many workers connect at once
+MAX_ACCEPTS = 64
+
 class WorkManager(object):
 
-    def __init__(self, address, port, authkey=None):
+    # What work_units() counts, used to name metrics
+    work_unit_name = "tasks"
+
+    def __init__(self, address, port, authkey=None, metrics_address=None,
+                 spot_check_rate=0.0):
 
         self.next_worker_id = 0
         self.tasks_finished = 0
@@ -16,8 +28,23 @@ class WorkManager(object):
         self.task_iter = iter(self.tasks())
         self.assigned_tasks = defaultdict(lambda: [])  # Maps connection objects to a list of assigned tasks
         self.dropped_tasks = []  # Dropped by workers on disconnect
-
-        self.listener = Listener((address, port), authkey=authkey)
+        self.assign_times = {}  # Maps (connection, task) to when it was sent
+
+        # Spot checks: this fraction of tasks sent are decoys from
+        # make_decoy() with a known answer.  A worker that gets one wrong, or
+        # disconnects with one outstanding, has every task it finished since
+        # its last passed decoy handed out again.
+        self.spot_check_rate = spot_check_rate
+        self.decoys = defaultdict(dict)  # Maps connection objects to {decoy task: expected answer}
+        self.finished_by = defaultdict(list)  # Maps connection objects to the tasks they finished since their last passed decoy
+
+        self.metrics = WorkMetrics(self.work_unit_name)
+        self.metrics.remaining_work = self.total_work()
+        self.metrics_server = None
+        if metrics_address:
+            self.metrics_server = MetricsServer(self.metrics, *metrics_address)
+
+        self.listener = Listener((address, port), backlog=MAX_ACCEPTS, authkey=authkey)
         self.listener._listener._socket.settimeout(0.0001)  # Set Nonblocking
 
     def run(self):
@@ -37,8 +64,16 @@ class WorkManager(object):
         finally:
             self.finish()
             self.listener.close()
+            if self.metrics_server:
+                self.metrics_server.close()
 
     def accept_new_clients(self):
+        for i in xrange(MAX_ACCEPTS):
+            if not self.accept_new_client():
+                break
+
+    def accept_new_client(self):
+        '''Accepts one waiting client.  Returns False if none was waiting.'''
 
         try:
             connection = self.listener.accept()
@@ -46,12 +81,13 @@ class WorkManager(object):
             self.log("Client failed to connect:", repr(e))
             connection = None
         except socket.timeout:
-            connection = None
+            return False
         if connection:
 
             # Send worker identifier
             worker_id = self.new_worker_id(connection)
             self.worker_ids[connection] = worker_id
+            self.metrics.worker_added(worker_id)
             connection.send(worker_id)
             self.log("Connected", worker=worker_id)
 
@@ -59,29 +95,121 @@ class WorkManager(object):
             # waiting on the worker's side of the connection.
             self.assign_task(connection)
             self.assign_task(connection)
+        return True
+
+    def ready_connections(self, timeout):
+        '''
+        Waits up to timeout seconds for workers to send something, and
+        returns their connections.  Also returns early if a new worker is
+        connecting.  This uses poll() because select() can't take file
+        descriptors past FD_SETSIZE, usually 1024.
+        '''
+        poller = poll()
+        connections = {}  # Maps file descriptors to connections
+        for connection in self.worker_ids:
+            connections[connection.fileno()] = connection
+            poller.register(connection.fileno(), POLLIN)
+        poller.register(self.listener._listener._socket.fileno(), POLLIN)
+        for connection in self.other_connections():
+            poller.register(connection.fileno(), POLLIN)
+        return [connections[fd] for fd, event in poller.poll(timeout * 1000)
+                if fd in connections]
+
+    def other_connections(self):
+        '''Connections besides workers' that should wake up the main loop.'''
+        return []
 
     def assign_tasks(self):
 
         connections_to_remove = []
-        for connection in select(self.worker_ids.keys(), [], [], 0.1)[0]:
+        for connection in self.ready_connections(0.1):
 
                 # Process results
-                result = False
+                message = False
                 try:
-                    result = connection.recv()
+                    message = connection.recv()
                 except (EOFError, IOError):
                     connections_to_remove.append(connection)
                     continue
-                self.tasks_finished += 1
-                self.assigned_tasks[connection].remove(result[0])
 
-                # Assign task
-                self.assign_task(connection)
-                self.process_result(self.worker_ids[connection], result[0], result[1])
+                # None is a request for an extra task.  Workers that compute
+                # several tasks at once use this to keep more than two tasks
+                # queued.
+                if message is None:
+                    self.assign_task(connection)
+                    continue
+
+                # Relays send a list of results at once.  Each still gets
+                # a task in return.
+                worker_id = self.worker_ids[connection]
+                for result in message if isinstance(message, list) else [message]:
+                    if result[0] in self.decoys[connection]:
+                        self.check_decoy(connection, result)
+                        if connection not in self.worker_ids:
+                            break  # Failed, or sending the next task failed
+                        continue
+
+                    self.tasks_finished += 1
+                    self.assigned_tasks[connection].remove(result[0])
+                    self.record_finished(connection, result)
+                    if self.spot_check_rate:
+                        self.finished_by[connection].append(result[0])
+
+                    # Assign task
+                    self.assign_task(connection)
+                    self.process_result(worker_id, result[0], result[1])
+                    if connection not in self.worker_ids:
+                        break  # Sending the task failed
 
         for connection in connections_to_remove:
             self.remove_worker(connection)
 
+    def record_finished(self, connection, result):
+        '''
+        Update metrics for a result.  Results are (task_data, result) or
+        (task_data, result, (queue_seconds, compute_seconds)).
+        '''
+        task_data = result[0]
+        timing = result[2] if len(result) > 2 else None
+        sent = self.assign_times.pop((connection, task_data), None)
+        round_trip = time() - sent if sent is not None else 0.0
+        self.metrics.outstanding -= 1
+        self.metrics.task_finished(self.worker_ids[connection],
+                                   self.work_units(task_data),
+                                   round_trip, timing)
+
+    def check_decoy(self, connection, result):
+        expected = self.decoys[connection].pop(result[0])
+        passed = self.decoy_passed(expected, result[1])
+        self.metrics.spot_checked(passed)
+        if passed:
+            # Results are returned in order, so the ones before this were
+            # made by a worker that was still searching
+            self.finished_by.pop(connection, None)
+            self.assign_task(connection)
+            return
+
+        self.log("Failed a spot check on %s." % (result[0],),
+                 worker=self.worker_ids[connection])
+        self.decoys.pop(connection, None)
+        self.redo_finished(connection)
+        connection.close()
+        self.remove_worker(connection)
+
+    def redo_finished(self, connection):
+        '''
+        Hands out again the tasks a worker finished since its last passed
+        decoy.  Nothing it returned in that time can be trusted.
+        '''
+        redo = self.finished_by.pop(connection, [])
+        self.log("Handing out the %d tasks it finished since its last passed "
+                 "spot check again." % len(redo), worker=self.worker_ids[connection])
+        for task in redo:
+            self.tasks_finished -= 1
+            self.metrics.work_redone(self.work_units(task))
+            self.unfinish(task)
+        self.dropped_tasks.extend(redo)
+
     def get_task(self):
 
         # Check dropped_tasks
@@ -97,9 +225,22 @@ class WorkManager(object):
             return False
 
     def assign_task(self, connection):
+        if (self.spot_check_rate and not self.all_tasks_enumerated and
+                random() < self.spot_check_rate):
+            task, expected = self.make_decoy()
+            try:
+                connection.send(task)
+            except IOError:
+                self.remove_worker(connection)
+                return
+            self.decoys[connection][task] = expected
+            return
+
         task = self.get_task()
         if task is not False:
             self.assigned_tasks[connection].append(task)
+            self.assign_times[(connection, task)] = time()
+            self.metrics.outstanding += 1
         try:
             connection.send(task)
         except IOError:
@@ -109,9 +250,21 @@ class WorkManager(object):
     def remove_worker(self, connection):
 
         worker_id = self.worker_ids[connection]
+        if self.decoys.get(connection):
+            # Leaving instead of answering a decoy could be dodging it
+            self.metrics.spot_checked(False)
+            self.log("Disconnected with a spot check outstanding.", worker=worker_id)
+            self.redo_finished(connection)
         self.dropped_tasks.extend(self.assigned_tasks[connection])
+        for task in self.assigned_tasks[connection]:
+            self.assign_times.pop((connection, task), None)
+        self.metrics.outstanding -= len(self.assigned_tasks[connection])
+        self.metrics.tasks_dropped(len(self.assigned_tasks[connection]))
+        self.metrics.worker_removed(worker_id)
         del self.worker_ids[connection]
         del self.assigned_tasks[connection]
+        self.decoys.pop(connection, None)
+        self.finished_by.pop(connection, None)
         self.log("Disconnected", worker=worker_id)
 
     def new_worker_id(self, connection):
@@ -125,6 +278,34 @@ class WorkManager(object):
     def process_result(self, worker_id, task_data, result):
         raise NotImplementedError("A subclass must implement this.")
 
+    def make_decoy(self):
+        '''
+        Returns (task_data, expected) for a spot check: a task that looks as
+        much like a real one as possible, and what its result must contain.
+        Only called if spot_check_rate is set.
+        '''
+        raise NotImplementedError("A subclass must implement this to use spot checks.")
+
+    def decoy_passed(self, expected, result):
+        '''Whether the result of a decoy task has the expected answer.'''
+        return result == expected
+
+    def unfinish(self, task_data):
+        '''
+        Called for each task that is handed out again because the worker
+        that finished it failed a spot check.  Undo what process_result()
+        recorded for it.
+        '''
+        pass
+
+    def work_units(self, task_data):
+        '''How much work a task is, in units of work_unit_name.'''
+        return 1
+
+    def total_work(self):
+        '''Work units in all tasks, or None if unknown.  Used for the ETA.'''
+        return None
+
     def finish(self):
         pass
 
@@ -142,6 +323,151 @@ class WorkManager(object):
         print
 
 
+class RelayManager(WorkManager):
+    '''
+    A manager for local workers that is itself a worker of another manager,
+    so the top manager only has one connection per relay instead of one per
+    worker.
+
+    Tasks from the parent are split with subdivide() into tasks for the
+    local workers.  Once every piece of a parent task is finished, their
+    results are joined with combine_results() and sent upstream.  Finished
+    parent tasks are sent together as a list, once batch_size of them are
+    waiting or the oldest has waited batch_seconds.  Parent tasks are asked
+    for ahead of time, so there are always about two local tasks per worker.
+    '''
+
+    def __init__(self, parent_address, parent_port, address, port,
+                 parent_authkey=None, authkey=None, metrics_address=None,
+                 batch_size=16, batch_seconds=5.0):
+
+        self.batch_size = batch_size
+        self.batch_seconds = batch_seconds
+        self.parent = Client((parent_address, parent_port), authkey=parent_authkey)
+        self.parent_worker_id = self.parent.recv()
+        self.parent_owed = 2  # Tasks the parent will send; it sends two on connect
+        self.parent_done = False  # The parent has run out of tasks
+        self.subtasks_per_task = 1  # Of the last parent task, to know how far to ask ahead
+        self.subtasks = deque()
+        self.parent_tasks = {}  # Maps parent tasks to [pieces left, results, time received]
+        self.subtask_parents = {}  # Maps local tasks to their parent task
+        self.waiting = []  # Connections owed a task once the parent sends more
+        self.batch = []  # Finished parent tasks not sent yet
+        self.batch_started = None
+
+        super(RelayManager, self).__init__(address, port, authkey, metrics_address)
+        self.log("Connected to parent as worker %s" % self.parent_worker_id)
+
+    def tasks(self):
+        return []  # Tasks come from the parent, through get_task()
+
+    def subdivide(self, task):
+        '''Splits a parent task into a list of tasks for local workers.'''
+        return [task]
+
+    def combine_results(self, task, results):
+        '''
+        The result to send upstream for a parent task, from the results of
+        each piece in the order subdivide() gave them.  Subclasses that split
+        tasks must override this.
+        '''
+        return results[0]
+
+    def other_connections(self):
+        return [self.parent]
+
+    def get_task(self):
+        if self.dropped_tasks:
+            return self.dropped_tasks.pop(0)
+        if self.subtasks:
+            return self.subtasks.popleft()
+        self.all_tasks_enumerated = True
+        return False
+
+    def assign_task(self, connection):
+        # Rather than tell the worker there's nothing left, make it wait
+        # until the parent sends more.
+        if not (self.dropped_tasks or self.subtasks or self.parent_done):
+            self.waiting.append(connection)
+            return
+        super(RelayManager, self).assign_task(connection)
+
+    def remove_worker(self, connection):
+        while connection in self.waiting:
+            self.waiting.remove(connection)
+        super(RelayManager, self).remove_worker(connection)
+
+    def assign_tasks(self):
+        super(RelayManager, self).assign_tasks()
+        self.receive_from_parent()
+        self.request_from_parent()
+        self.send_batch()
+
+    def receive_from_parent(self):
+        try:
+            while self.parent.poll():
+                task = self.parent.recv()
+                self.parent_owed -= 1
+                if task is False:
+                    self.parent_done = True
+                    continue
+                subtasks = self.subdivide(task)
+                self.subtasks_per_task = len(subtasks)
+                self.parent_tasks[task] = [len(subtasks), [None] * len(subtasks), time()]
+                for i, subtask in enumerate(subtasks):
+                    self.subtask_parents[subtask] = (task, i)
+                self.subtasks.extend(subtasks)
+        except (EOFError, IOError):
+            self.parent = None
+            raise IOError("Lost the connection to the parent manager")
+
+        while self.waiting and (self.dropped_tasks or self.subtasks or self.parent_done):
+            super(RelayManager, self).assign_task(self.waiting.pop(0))
+        if self.parent_done and not self.subtasks:
+            self.all_tasks_enumerated = True
+
+    def request_from_parent(self):
+        if self.parent_done:
+            return
+        wanted = 2 * len(self.worker_ids)
+        have = len(self.subtasks) + self.parent_owed * self.subtasks_per_task
+        while have < wanted:
+            self.parent.send(None)
+            self.parent_owed += 1
+            have += self.subtasks_per_task
+
+    def process_result(self, worker_id, task_data, result):
+        task, i = self.subtask_parents.pop(task_data)
+        entry = self.parent_tasks[task]
+        entry[0] -= 1
+        entry[1][i] = result
+        if entry[0] == 0:
+            del self.parent_tasks[task]
+            if not self.batch:
+                self.batch_started = time()
+            self.batch.append((task, self.combine_results(task, entry[1]),
+                               (None, time() - entry[2])))
+
+    def send_batch(self, force=False):
+        '''Sends finished parent tasks upstream if the batch is due.'''
+        if not self.batch or not self.parent:
+            return
+        if force or len(self.batch) >= self.batch_size or \
+                time() - self.batch_started >= self.batch_seconds or \
+                (self.parent_done and not self.parent_tasks):
+            self.parent.send(self.batch)
+            if not self.parent_done:
+                self.parent_owed += len(self.batch)
+            self.batch = []
+
+    def finish(self):
+        if self.parent:
+            self.send_batch(force=True)
+            self.parent.close()
+        if self.parent_tasks:
+            self.log("%d parent tasks unfinished; the parent will hand them out again" % len(self.parent_tasks))
+
+
 class Worker(object):
 
     def __init__(self, address, port, authkey=None):
@@ -156,8 +482,11 @@ class Worker(object):
             if task_data is False:
                 return
 
+            # This worker can't tell how long a task waited in the
+            # connection, so queue time is reported as unknown.
+            start = time()
             result = self.do_task(task_data)
-            self.connection.send((task_data, result))
+            self.connection.send((task_data, result, (None, time() - start)))
 
     def log(self, *items):
         print "== Worker %s ==" % self.worker_id,
@@ -0,0 +1,205 @@
+
+import threading
+from time import time
+from collections import deque
+from BaseHTTPServer import HTTPServer, BaseHTTPRequestHandler
+
+# Upper bounds (in seconds) of the latency histogram buckets
+LATENCY_BUCKETS = [0.001, 0.01, 0.1, 0.5, 1, 5, 10, 30, 60, 300, 1800, 3600]
+
+# Rates are averaged over this many seconds
+RATE_WINDOW = 60.0
+
+class Histogram(object):
+    '''A cumulative histogram, as Prometheus expects them.'''
+
+    def __init__(self, buckets=LATENCY_BUCKETS):
+        self.buckets = buckets
+        self.counts = [0] * len(buckets)
+        self.count = 0
+        self.sum = 0.0
+
+    def observe(self, value):
+        for i, bound in enumerate(self.buckets):
+            if value <= bound:
+                self.counts[i] += 1
+        self.count += 1
+        self.sum += value
+
+    def render(self, name, labels=''):
+        lines = []
+        sep = ',' if labels else ''
+        for bound, count in zip(self.buckets, self.counts):
+            lines.append('%s_bucket{%s%sle="%s"} %d' % (name, labels, sep, bound, count))
+        lines.append('%s_bucket{%s%sle="+Inf"} %d' % (name, labels, sep, self.count))
+        labels = '{%s}' % labels if labels else ''
+        lines.append('%s_sum%s %f' % (name, labels, self.sum))
+        lines.append('%s_count%s %d' % (name, labels, self.count))
+        return lines
+
+class Rate(object):
+    '''Work done per second over the last RATE_WINDOW seconds.'''
+
+    def __init__(self):
+        self.events = deque()  # (time, amount)
+        self.total = 0
+        self.created = time()
+
+    def add(self, amount, now=None):
+        now = now or time()
+        self.events.append((now, amount))
+        self.total += amount
+
+    def per_second(self, now=None):
+        now = now or time()
+        while self.events and self.events[0][0] < now - RATE_WINDOW:
+            self.events.popleft()
+        window = min(RATE_WINDOW, now - self.created)
+        if window <= 0:
+            return 0.0
+        return sum(amount for t, amount in self.events) / window
+
+class WorkMetrics(object):
+    '''
+    Throughput and latency of a WorkManager.
+
+    Task latency is split into three parts:
+      queue - From being sent to a worker until the worker starts it.
+      compute - Time the worker spent computing.
+      return - The rest of the round trip, mostly network transit.
+    Workers report queue and compute time with their results.  Workers that
+    don't know when a task arrived report None for queue time, in which case
+    all of the waiting is counted as queue time.
+    '''
+
+    def __init__(self, unit="tasks"):
+        self.unit = unit
+        self.lock = threading.Lock()
+        self.start_time = time()
+        self.rates = {}  # Maps worker ids to rates, from when they connected
+        self.total_rate = Rate()
+        self.latency = {
+            "queue": Histogram(),
+            "compute": Histogram(),
+            "return": Histogram(),
+        }
+        self.completed = 0
+        self.dropped = 0
+        self.outstanding = 0
+        self.spot_checks = 0
+        self.spot_checks_failed = 0
+        self.remaining_work = None  # Unknown until the manager sets it
+
+    def worker_added(self, worker_id):
+        with self.lock:
+            self.rates[worker_id] = Rate()
+
+    def task_finished(self, worker_id, work, round_trip, timing):
+        queue_time, compute_time = timing if timing else (None, None)
+        with self.lock:
+            now = time()
+            self.completed += 1
+            self.rates[worker_id].add(work, now)
+            self.total_rate.add(work, now)
+            if compute_time is not None:
+                if queue_time is None:
+                    queue_time = max(round_trip - compute_time, 0.0)
+                return_time = max(round_trip - queue_time - compute_time, 0.0)
+                self.latency["queue"].observe(queue_time)
+                self.latency["compute"].observe(compute_time)
+                self.latency["return"].observe(return_time)
+            if self.remaining_work is not None:
+                self.remaining_work -= work
+
+    def tasks_dropped(self, count):
+        with self.lock:
+            self.dropped += count
+
+    def spot_checked(self, passed):
+        with self.lock:
+            self.spot_checks += 1
+            if not passed:
+                self.spot_checks_failed += 1
+
+    def work_redone(self, work):
+        with self.lock:
+            if self.remaining_work is not None:
+                self.remaining_work += work
+
+    def worker_removed(self, worker_id):
+        with self.lock:
+            self.rates.pop(worker_id, None)
+
+    def render(self):
+        '''Returns all metrics in the Prometheus text format.'''
+        unit = self.unit
+        lines = []
+        def metric(name, kind, help_text):
+            lines.append("# HELP %s %s" % (name, help_text))
+            lines.append("# TYPE %s %s" % (name, kind))
+
+        with self.lock:
+            now = time()
+            total_rate = self.total_rate.per_second(now)
+
+            name = "distproc_%s_per_second" % unit
+            metric(name, "gauge", "Average %s per second over the last %d seconds." % (unit, RATE_WINDOW))
+            lines.append("%s %f" % (name, total_rate))
+            for worker_id, rate in sorted(self.rates.items()):
+                lines.append('%s{worker="%s"} %f' % (name, worker_id, rate.per_second(now)))
+
+            name = "distproc_%s_total" % unit
+            metric(name, "counter", "Total %s finished." % unit)
+            lines.append("%s %d" % (name, self.total_rate.total))
+
+            for name, value, help_text in [
+                    ("distproc_tasks_outstanding", self.outstanding, "Tasks assigned to workers but not finished."),
+                    ("distproc_tasks_completed_total", self.completed, "Tasks finished."),
+                    ("distproc_tasks_dropped_total", self.dropped, "Tasks dropped by disconnecting workers."),
+                    ("distproc_spot_checks_total", self.spot_checks, "Decoy tasks with a known answer finished or abandoned by workers."),
+                    ("distproc_spot_checks_failed_total", self.spot_checks_failed, "Decoy tasks that workers got wrong or disconnected without answering."),
+                    ("distproc_uptime_seconds", now - self.start_time, "Seconds since the manager started.")]:
+                metric(name, "counter" if name.endswith("_total") else "gauge", help_text)
+                lines.append("%s %s" % (name, value))
+
+            for phase in ("queue", "compute", "return"):
+                name = "distproc_task_%s_seconds" % phase
+                metric(name, "histogram", "Task %s latency." % phase)
+                lines.extend(self.latency[phase].render(name))
+
+            if self.remaining_work is not None:
+                name = "distproc_remaining_%s" % unit
+                metric(name, "gauge", "%s left to search." % unit.capitalize())
+                lines.append("%s %d" % (name, self.remaining_work))
+                if total_rate > 0:
+                    name = "distproc_eta_seconds"
+                    metric(name, "gauge", "Projected seconds until all %s are finished." % unit)
+                    lines.append("%s %f" % (name, self.remaining_work / total_rate))
+
+        return "\n".join(lines) + "\n"
+
+class MetricsServer(object):
+    '''Serves WorkMetrics.render() over HTTP from a background thread.'''
+
+    def __init__(self, metrics, address, port):
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                body = metrics.render()
+                self.send_response(200)
+                self.send_header("Content-Type", "text/plain; version=0.0.4")
+                self.send_header("Content-Length", str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def log_message(self, *args):
+                pass
+
+        self.server = HTTPServer((address, port), Handler)
+        self.thread = threading.Thread(target=self.server.serve_forever)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def close(self):
+        self.server.shutdown()
+        self.server.server_close()
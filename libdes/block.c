@@ -0,0 +1,482 @@
+/*
+ * Encryption and decryption for libdes, on top of the bitsliced rounds in
+ * include/des_64.h.
+ *
+ * Everything goes through the same 64 lane rounds.  A single block is
+ * broadcast to all 64 lanes instead of being zipped, so it costs one pass;
+ * bulk calls zip 64 blocks at a time, so they cost one pass per 64 blocks.
+ *
+ * ECB, CBC decryption and CTR don't depend on earlier output, so the _mt
+ * calls split the buffer into one range of whole 64 block tiles per thread.
+ * CBC encryption and OFB do, so they are one block per pass.
+ *
+ * CTR never zips its input.  The 64 counters of a tile only differ in their
+ * low 6 bits (and a carry), so their zipped form is built directly: the low
+ * 6 slices are fixed lane patterns, like the constant slices check_keys puts
+ * in keys_zipped, and the rest are all ones or all zeros.  Only the
+ * keystream is unzipped, to XOR into the buffer.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "des_64.h"  // des_encrypt, des_decrypt, zip_64_bit
+#include "libdes.h"
+
+#if BS_WIDTH != 64
+#error "libdes is built with BS_WIDTH=64"
+#endif
+
+// Buffers smaller than this per thread aren't worth starting a thread for
+#define MIN_THREAD_BYTES (64*1024)
+
+enum mode { MODE_ECB, MODE_CBC, MODE_CTR };
+
+// A range of blocks for one thread to encrypt or decrypt
+struct crypt_range {
+    const struct libdes_key* key;
+    const unsigned char* in;  // NULL for a CTR keystream by itself
+    unsigned char* out;
+    size_t length;
+    int decrypt;
+    enum mode mode;
+    uint64_t iv;  // For CBC, the ciphertext block before in.  For CTR, the counter of in's first block.
+};
+
+// Bit j of the lane number in each lane, as a slice
+static const uint64_t lane_number_bits[6] = {
+    0x5555555555555555ULL, 0x3333333333333333ULL, 0x0f0f0f0f0f0f0f0fULL,
+    0x00ff00ff00ff00ffULL, 0x0000ffff0000ffffULL, 0x00000000ffffffffULL
+};
+
+static uint64_t load_block(const unsigned char* bytes) {
+    uint64_t block = 0;
+    for (int i=0; i<8; i++) {
+        block = block << 8 | bytes[i];
+    }
+    return block;
+}
+
+static void store_block(unsigned char* bytes, uint64_t block) {
+    for (int i=7; i>=0; i--) {
+        bytes[i] = block & 0xff;
+        block >>= 8;
+    }
+}
+
+// Every lane gets the same value, so each slice is all ones or all zeros
+static void broadcast(uint64_t value, uint64_t zipped[64]) {
+    for (int i=0; i<64; i++) {
+        zipped[i] = (value >> (63-i)) & 1 ? 0xffffffffffffffffLL : 0;
+    }
+}
+
+// Inverse of broadcast, reading lane 0
+static uint64_t unbroadcast(const uint64_t zipped[64]) {
+    uint64_t value = 0;
+    for (int i=0; i<64; i++) {
+        value = value << 1 | zipped[i] >> 63;
+    }
+    return value;
+}
+
+int libdes_version(void) {
+    return LIBDES_VERSION;
+}
+
+void libdes_set_key(struct libdes_key* key, uint64_t des_key) {
+    broadcast(des_key, key->key_bits);
+}
+
+uint64_t libdes_key_from_56(uint64_t key56) {
+    uint64_t des_key = 0;
+    for (int i=0; i<8; i++) {
+        des_key = des_key << 8 | ((key56 >> (49 - 7*i)) & 0x7f) << 1;
+    }
+    return des_key;
+}
+
+uint64_t libdes_key_to_56(uint64_t des_key) {
+    uint64_t key56 = 0;
+    for (int i=0; i<8; i++) {
+        key56 = key56 << 7 | ((des_key >> (57 - 8*i)) & 0x7f);
+    }
+    return key56;
+}
+
+uint64_t libdes_encrypt_block(const struct libdes_key* key, uint64_t block) {
+    uint64_t block_bits[64];
+    broadcast(block, block_bits);
+    des_encrypt(block_bits, key->key_bits);
+    return unbroadcast(block_bits);
+}
+
+uint64_t libdes_decrypt_block(const struct libdes_key* key, uint64_t block) {
+    uint64_t block_bits[64];
+    broadcast(block, block_bits);
+    des_decrypt(block_bits, key->key_bits);
+    return unbroadcast(block_bits);
+}
+
+/*
+ * Zips counter, counter+1, ... counter+63 without a transpose.  With
+ * counter's low 6 bits as the offset, lane l's low bits are l + offset, so
+ * each low slice is a lane pattern rotated by offset.  Lanes that wrap past
+ * 63 carry into the upper bits, which are otherwise the same in every lane.
+ */
+static void zip_counters(uint64_t counter, uint64_t zipped[64]) {
+    int offset = counter & 63;
+    uint64_t first = counter - offset;
+    uint64_t carried = first + 64;
+    uint64_t first_lanes = ~0ULL << offset;  // Lanes before the carry
+
+    for (int i=0; i<58; i++) {
+        zipped[i] = ((first >> (63-i)) & 1 ? first_lanes : 0) |
+                    ((carried >> (63-i)) & 1 ? ~first_lanes : 0);
+    }
+    for (int j=0; j<6; j++) {
+        uint64_t pattern = lane_number_bits[j];
+        zipped[63-j] = offset ? pattern << offset | pattern >> (64 - offset) : pattern;
+    }
+}
+
+// CTR of one range: XORs the keystream into in, or just writes it
+static void ctr_range(const struct crypt_range* range) {
+    const unsigned char* in = range->in;
+    unsigned char* out = range->out;
+    uint64_t counters_zipped[64];
+    uint64_t keystream[64];
+    uint64_t counter = range->iv;
+
+    for (size_t offset=0; offset<range->length; offset += 64*8, counter += 64) {
+        zip_counters(counter, counters_zipped);
+        des_encrypt(counters_zipped, range->key->key_bits);
+        zip_64_bit(counters_zipped, keystream);
+
+        size_t bytes = range->length - offset < 64*8 ? range->length - offset : 64*8;
+        for (size_t i=0; i<bytes/8; i++) {
+            uint64_t block = in ? load_block(&in[offset + i*8]) : 0;
+            store_block(&out[offset + i*8], block ^ keystream[i]);
+        }
+        for (size_t b=bytes - bytes%8; b<bytes; b++) {
+            uint64_t byte = keystream[b/8] >> (56 - 8*(b%8));
+            out[offset + b] = (in ? in[offset + b] : 0) ^ (byte & 0xff);
+        }
+    }
+}
+
+// ECB, or CBC decryption, of one range.  in and out may be the same.
+static void crypt_range(const struct crypt_range* range) {
+    const unsigned char* in = range->in;
+    unsigned char* out = range->out;
+    uint64_t blocks[64];
+    uint64_t blocks_zipped[64];
+    uint64_t results[64];
+    uint64_t chain = range->iv;
+
+    if (range->mode == MODE_CTR) {
+        ctr_range(range);
+        return;
+    }
+    for (size_t offset=0; offset<range->length; offset += 64*8) {
+        int n = (range->length - offset) / 8 < 64 ? (range->length - offset) / 8 : 64;
+        for (int i=0; i<64; i++) {
+            blocks[i] = i < n ? load_block(&in[offset + i*8]) : 0;
+        }
+
+        zip_64_bit(blocks, blocks_zipped);
+        if (range->decrypt) {
+            des_decrypt(blocks_zipped, range->key->key_bits);
+        } else {
+            des_encrypt(blocks_zipped, range->key->key_bits);
+        }
+        zip_64_bit(blocks_zipped, results);
+
+        // blocks still has the ciphertext, even if out is in
+        if (range->mode == MODE_CBC) {
+            results[0] ^= chain;
+            for (int i=1; i<n; i++) {
+                results[i] ^= blocks[i-1];
+            }
+            chain = blocks[n-1];
+        }
+        for (int i=0; i<n; i++) {
+            store_block(&out[offset + i*8], results[i]);
+        }
+    }
+}
+
+static void* crypt_thread(void* range) {
+    crypt_range(range);
+    return NULL;
+}
+
+// Threads to use for length bytes of work, given the caller's num_threads
+static int thread_count(int num_threads, size_t length) {
+    if (num_threads <= 0) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((size_t) num_threads > length / MIN_THREAD_BYTES) {
+        num_threads = length / MIN_THREAD_BYTES;
+    }
+    return num_threads;
+}
+
+/*
+ * Calls function on each of num_threads ranges, each in its own thread.
+ * The first range is done on this thread.  If a thread can't be started,
+ * its range is done here too.  Returns -1 if memory runs out.
+ */
+static int run_threads(void* (*function)(void*), void* ranges, size_t range_size, int num_threads) {
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    int* started = malloc(num_threads * sizeof(int));
+    if (!threads || !started) {
+        free(threads);
+        free(started);
+        return -1;
+    }
+
+    for (int i=1; i<num_threads; i++) {
+        started[i] = !pthread_create(&threads[i], NULL, function, (char*) ranges + i*range_size);
+    }
+    function(ranges);
+    for (int i=1; i<num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            function((char*) ranges + i*range_size);
+        }
+    }
+
+    free(threads);
+    free(started);
+    return 0;
+}
+
+static int crypt_buffer(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length, int decrypt, enum mode mode, uint64_t iv, int num_threads) {
+    if (length % 8 && mode != MODE_CTR) {
+        return -1;
+    }
+    num_threads = thread_count(num_threads, length);
+    if (num_threads <= 1) {
+        const struct crypt_range range = {key, in, out, length, decrypt, mode, iv};
+        crypt_range(&range);
+        return 0;
+    }
+
+    struct crypt_range* ranges = malloc(num_threads * sizeof(struct crypt_range));
+    if (!ranges) {
+        return -1;
+    }
+
+    // Ranges are whole tiles, except for the last.  Each CBC chain value is
+    // read before any thread starts, since out may be in.  CTR ranges just
+    // start at a later counter.
+    size_t num_tiles = (length + 64*8 - 1) / (64*8);
+    size_t start = 0;
+    for (int i=0; i<num_threads; i++) {
+        size_t end = (num_tiles * (i+1) / num_threads) * 64*8;
+        if (end > length) {
+            end = length;
+        }
+        uint64_t range_iv = iv;
+        if (mode == MODE_CBC && start) {
+            range_iv = load_block(&in[start - 8]);
+        } else if (mode == MODE_CTR) {
+            range_iv = iv + start / 8;
+        }
+        ranges[i] = (struct crypt_range) {
+            key, in ? in + start : NULL, out + start, end - start, decrypt, mode, range_iv
+        };
+        start = end;
+    }
+
+    int result = run_threads(crypt_thread, ranges, sizeof(struct crypt_range), num_threads);
+    free(ranges);
+    return result;
+}
+
+int libdes_ecb_encrypt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length) {
+    return crypt_buffer(key, in, out, length, 0, MODE_ECB, 0, 1);
+}
+
+int libdes_ecb_decrypt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length) {
+    return crypt_buffer(key, in, out, length, 1, MODE_ECB, 0, 1);
+}
+
+int libdes_ecb_encrypt_mt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length, int num_threads) {
+    return crypt_buffer(key, in, out, length, 0, MODE_ECB, 0, num_threads);
+}
+
+int libdes_ecb_decrypt_mt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length, int num_threads) {
+    return crypt_buffer(key, in, out, length, 1, MODE_ECB, 0, num_threads);
+}
+
+int libdes_cbc_encrypt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length) {
+    if (length % 8) {
+        return -1;
+    }
+    for (size_t offset=0; offset<length; offset += 8) {
+        iv = libdes_encrypt_block(key, load_block(&in[offset]) ^ iv);
+        store_block(&out[offset], iv);
+    }
+    return 0;
+}
+
+int libdes_cbc_decrypt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length) {
+    return crypt_buffer(key, in, out, length, 1, MODE_CBC, iv, 1);
+}
+
+int libdes_cbc_decrypt_mt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length, int num_threads) {
+    return crypt_buffer(key, in, out, length, 1, MODE_CBC, iv, num_threads);
+}
+
+void libdes_ctr_crypt(const struct libdes_key* key, uint64_t counter, const unsigned char* in, unsigned char* out, size_t length) {
+    crypt_buffer(key, in, out, length, 0, MODE_CTR, counter, 1);
+}
+
+int libdes_ctr_crypt_mt(const struct libdes_key* key, uint64_t counter, const unsigned char* in, unsigned char* out, size_t length, int num_threads) {
+    return crypt_buffer(key, in, out, length, 0, MODE_CTR, counter, num_threads);
+}
+
+void libdes_ctr_keystream(const struct libdes_key* key, uint64_t counter, unsigned char* out, size_t length) {
+    crypt_buffer(key, NULL, out, length, 0, MODE_CTR, counter, 1);
+}
+
+void libdes_ofb_crypt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length) {
+    for (size_t offset=0; offset<length; offset += 8) {
+        iv = libdes_encrypt_block(key, iv);
+        for (size_t b=offset; b<length && b<offset+8; b++) {
+            out[b] = in[b] ^ ((iv >> (56 - 8*(b - offset))) & 0xff);
+        }
+    }
+}
+
+/*
+ * The PRNG is the CTR keystream.  The seed's low 56 bits are the key and
+ * the top 8 pick where the counter starts, so every seed gives a different
+ * stream.
+ */
+void libdes_prng_seed(struct libdes_prng* prng, uint64_t seed) {
+    libdes_set_key(&prng->key, libdes_key_from_56(seed & 0xffffffffffffffULL));
+    prng->counter = seed >> 56 << 56;
+    prng->available = 0;
+}
+
+uint64_t libdes_prng_next(struct libdes_prng* prng) {
+    if (!prng->available) {
+        uint64_t counters_zipped[64];
+        zip_counters(prng->counter, counters_zipped);
+        des_encrypt(counters_zipped, prng->key.key_bits);
+        zip_64_bit(counters_zipped, prng->buffer);
+        prng->counter += 64;
+        prng->available = 64;
+    }
+    return prng->buffer[64 - prng->available--];
+}
+
+void libdes_prng_fill(struct libdes_prng* prng, unsigned char* out, size_t length) {
+    for (size_t offset=0; offset<length; offset += 8) {
+        uint64_t value = libdes_prng_next(prng);
+        for (size_t b=offset; b<length && b<offset+8; b++) {
+            out[b] = (value >> (56 - 8*(b - offset))) & 0xff;
+        }
+    }
+}
+
+// A range of (key, block) pairs for one thread
+struct many_range {
+    const uint64_t* keys;
+    const uint64_t* in;
+    uint64_t* out;
+    size_t count;
+    int decrypt;
+};
+
+// Zips 64 keys and 64 blocks at a time, so each lane has its own key
+static void many_range(const struct many_range* range) {
+    uint64_t keys[64];
+    uint64_t blocks[64];
+    uint64_t keys_zipped[64];
+    uint64_t blocks_zipped[64];
+
+    for (size_t offset=0; offset<range->count; offset += 64) {
+        size_t n = range->count - offset < 64 ? range->count - offset : 64;
+        for (size_t i=0; i<64; i++) {
+            keys[i] = i < n ? range->keys[offset + i] : 0;
+            blocks[i] = i < n ? range->in[offset + i] : 0;
+        }
+
+        zip_64_bit(keys, keys_zipped);
+        zip_64_bit(blocks, blocks_zipped);
+        if (range->decrypt) {
+            des_decrypt(blocks_zipped, keys_zipped);
+        } else {
+            des_encrypt(blocks_zipped, keys_zipped);
+        }
+        zip_64_bit(blocks_zipped, blocks);
+
+        memcpy(&range->out[offset], blocks, n * sizeof(uint64_t));
+    }
+}
+
+static void* many_thread(void* range) {
+    many_range(range);
+    return NULL;
+}
+
+static int crypt_many(const uint64_t* keys, const uint64_t* in, uint64_t* out, size_t count, int decrypt, int num_threads) {
+    num_threads = thread_count(num_threads, count * 8);
+    if (num_threads <= 1) {
+        const struct many_range range = {keys, in, out, count, decrypt};
+        many_range(&range);
+        return 0;
+    }
+
+    struct many_range* ranges = malloc(num_threads * sizeof(struct many_range));
+    if (!ranges) {
+        return -1;
+    }
+    size_t num_tiles = (count + 63) / 64;
+    size_t start = 0;
+    for (int i=0; i<num_threads; i++) {
+        size_t end = (num_tiles * (i+1) / num_threads) * 64;
+        if (end > count) {
+            end = count;
+        }
+        ranges[i] = (struct many_range) {
+            keys + start, in + start, out + start, end - start, decrypt
+        };
+        start = end;
+    }
+
+    int result = run_threads(many_thread, ranges, sizeof(struct many_range), num_threads);
+    free(ranges);
+    return result;
+}
+
+int libdes_encrypt_many(const uint64_t* keys, const uint64_t* blocks, uint64_t* out, size_t count, int num_threads) {
+    return crypt_many(keys, blocks, out, count, 0, num_threads);
+}
+
+int libdes_decrypt_many(const uint64_t* keys, const uint64_t* blocks, uint64_t* out, size_t count, int num_threads) {
+    return crypt_many(keys, blocks, out, count, 1, num_threads);
+}
+
+void libdes_zip(const uint64_t input[64], uint64_t output[64]) {
+    zip_64_bit(input, output);
+}
+
+void libdes_encrypt_zipped(uint64_t blocks_zipped[64], const uint64_t keys_zipped[64]) {
+    des_encrypt(blocks_zipped, keys_zipped);
+}
+
+void libdes_decrypt_zipped(uint64_t blocks_zipped[64], const uint64_t keys_zipped[64]) {
+    des_decrypt(blocks_zipped, keys_zipped);
+}
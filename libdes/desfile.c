@@ -0,0 +1,109 @@
+/*
+ * Encrypts or decrypts a file with libdes_crypt_file.
+ *
+ * ECB, CBC decryption and CTR use every core; CBC encryption is one block
+ * at a time.  With -v, the throughput is printed to stderr.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "libdes.h"
+#include "parse.h"  // parse_hex
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: desfile [options] KEY INPUT OUTPUT\n"
+        "\n"
+        "Encrypts INPUT into OUTPUT with DES.  KEY is 16 hex digits.  Without -p\n"
+        "or -n, INPUT must be a multiple of 8 bytes.\n"
+        "\n"
+        "Options:\n"
+        "  -d          Decrypt.\n"
+        "  -c IV       CBC mode with the 16 hex digit IV.  Default is ECB.\n"
+        "  -n COUNTER  CTR mode, starting at the 16 hex digit COUNTER.  Any\n"
+        "              length of INPUT works, and -d and -p do nothing.\n"
+        "  -p          Add PKCS#5 padding, or remove it with -d.\n"
+        "  -t THREADS  Number of threads.  Default is the number of cores.\n"
+        "  -v          Print the throughput to stderr.\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int flags = 0;
+    uint64_t iv = 0;
+    int num_threads = 0;
+    int verbose = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "dc:n:pt:vh")) != -1) {
+        switch (opt) {
+            case 'd':
+                flags |= LIBDES_DECRYPT;
+                break;
+            case 'c':
+                flags |= LIBDES_CBC;
+                iv = parse_hex(optarg, 16);
+                break;
+            case 'n':
+                flags |= LIBDES_CTR;
+                iv = parse_hex(optarg, 16);
+                break;
+            case 'p':
+                flags |= LIBDES_PAD;
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                if (num_threads < 1) {
+                    usage();
+                }
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (argc - optind != 3 || (flags & LIBDES_CBC && flags & LIBDES_CTR)) {
+        usage();
+    }
+
+    struct libdes_key key;
+    libdes_set_key(&key, parse_hex(argv[optind], 16));
+    const char* in_path = argv[optind+1];
+    const char* out_path = argv[optind+2];
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (libdes_crypt_file(&key, in_path, out_path, flags, iv, num_threads)) {
+        if (errno == EINVAL) {
+            fprintf(stderr, "Error: %s\n", flags & LIBDES_DECRYPT && flags & LIBDES_PAD ?
+                    "Input length or padding is wrong, or the key is" :
+                    "Input is not a multiple of 8 bytes, or is the output file");
+        } else {
+            perror("Error");
+        }
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (verbose) {
+        struct stat in_stat;
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (!stat(in_path, &in_stat)) {
+            fprintf(stderr, "%lld bytes in %.3f seconds, %.1f MB/s\n",
+                    (long long) in_stat.st_size, seconds, in_stat.st_size / seconds / 1e6);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * File encryption for libdes.
+ *
+ * Both files are memory mapped: the input read only, and the output sized
+ * up front with ftruncate and mapped shared, so each thread reads blocks
+ * out of the input's page cache and writes them straight into the output's.
+ * There are no read or write copies, and no buffer to hand between threads.
+ *
+ * Only the full blocks go through the bulk calls in block.c.  The padded
+ * last block, if any, is done on its own.  CTR needs no padding, so it does
+ * the whole file.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libdes.h"
+
+static uint64_t load_block(const unsigned char* bytes) {
+    uint64_t block = 0;
+    for (int i=0; i<8; i++) {
+        block = block << 8 | bytes[i];
+    }
+    return block;
+}
+
+static void store_block(unsigned char* bytes, uint64_t block) {
+    for (int i=7; i>=0; i--) {
+        bytes[i] = block & 0xff;
+        block >>= 8;
+    }
+}
+
+// Pads the last partial block (PKCS#5) and encrypts it.  chain is the
+// block before it for CBC.
+static void encrypt_last_block(const struct libdes_key* key, const unsigned char* in, size_t in_length, unsigned char* out, int cbc, uint64_t chain) {
+    unsigned char last[8];
+    size_t remainder = in_length % 8;
+    if (remainder) {
+        memcpy(last, in, remainder);
+    }
+    memset(last + remainder, 8 - remainder, 8 - remainder);
+    uint64_t block = load_block(last);
+    if (cbc) {
+        block ^= chain;
+    }
+    store_block(out, libdes_encrypt_block(key, block));
+}
+
+// Returns the number of padding bytes at the end of a decrypted buffer, or
+// 0 if the padding is invalid
+static int padding_length(const unsigned char* out, size_t length) {
+    if (length < 8) {
+        return 0;
+    }
+    int padding = out[length - 1];
+    if (padding < 1 || padding > 8) {
+        return 0;
+    }
+    for (int i=1; i<=padding; i++) {
+        if (out[length - i] != padding) {
+            return 0;
+        }
+    }
+    return padding;
+}
+
+static int crypt_mapped(const struct libdes_key* key, const unsigned char* in, size_t in_length, unsigned char* out, int flags, uint64_t iv, int num_threads) {
+    int decrypt = flags & LIBDES_DECRYPT;
+    int cbc = flags & LIBDES_CBC;
+    size_t length = in_length - in_length % 8;
+    if (flags & LIBDES_CTR) {
+        return libdes_ctr_crypt_mt(key, iv, in, out, in_length, num_threads);
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    if (decrypt && cbc) {
+        return libdes_cbc_decrypt_mt(key, iv, in, out, length, num_threads);
+    } else if (decrypt) {
+        return libdes_ecb_decrypt_mt(key, in, out, length, num_threads);
+    } else if (cbc) {
+        return libdes_cbc_encrypt(key, iv, in, out, length);
+    } else {
+        return libdes_ecb_encrypt_mt(key, in, out, length, num_threads);
+    }
+}
+
+int libdes_crypt_file(const struct libdes_key* key, const char* in_path, const char* out_path, int flags, uint64_t iv, int num_threads) {
+    int decrypt = flags & LIBDES_DECRYPT;
+    int pad = flags & LIBDES_PAD && !(flags & LIBDES_CTR);
+    int in_fd = -1, out_fd = -1;
+    unsigned char* in = MAP_FAILED;
+    unsigned char* out = MAP_FAILED;
+    size_t in_length = 0, out_length = 0, out_mapped = 0;
+    struct stat in_stat, out_stat;
+    int result = -1;
+    int error = 0;
+
+    in_fd = open(in_path, O_RDONLY);
+    if (in_fd < 0 || fstat(in_fd, &in_stat)) {
+        goto cleanup;
+    }
+    in_length = in_stat.st_size;
+
+    // Truncating the output first would lose the input
+    if (!stat(out_path, &out_stat) && out_stat.st_dev == in_stat.st_dev &&
+            out_stat.st_ino == in_stat.st_ino) {
+        error = EINVAL;
+        goto cleanup;
+    }
+    if ((flags & LIBDES_CBC && flags & LIBDES_CTR) ||
+            (in_length % 8 && !(pad && !decrypt) && !(flags & LIBDES_CTR)) ||
+            (pad && decrypt && in_length == 0)) {
+        error = EINVAL;
+        goto cleanup;
+    }
+    out_length = pad && !decrypt ? in_length - in_length % 8 + 8 : in_length;
+
+    out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (out_fd < 0 || ftruncate(out_fd, out_length)) {
+        goto cleanup;
+    }
+    if (in_length) {
+        in = mmap(NULL, in_length, PROT_READ, MAP_SHARED, in_fd, 0);
+        if (in == MAP_FAILED) {
+            goto cleanup;
+        }
+        posix_madvise(in, in_length, POSIX_MADV_SEQUENTIAL);
+    }
+    if (out_length) {
+        out = mmap(NULL, out_length, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+        if (out == MAP_FAILED) {
+            goto cleanup;
+        }
+        out_mapped = out_length;
+    }
+
+    if (crypt_mapped(key, in, in_length, out, flags, iv, num_threads)) {
+        error = ENOMEM;  // The only way the bulk calls fail here
+        goto cleanup;
+    }
+    if (pad && !decrypt) {
+        size_t length = in_length - in_length % 8;
+        uint64_t chain = length ? load_block(&out[length - 8]) : iv;
+        encrypt_last_block(key, in + length, in_length, out + length, flags & LIBDES_CBC, chain);
+    }
+    if (pad && decrypt) {
+        int padding = padding_length(out, out_length);
+        if (!padding) {
+            error = EINVAL;
+            goto cleanup;
+        }
+        out_length -= padding;
+    }
+    result = 0;
+
+cleanup:
+    if (!error && result) {
+        error = errno;
+    }
+    if (in != MAP_FAILED) {
+        munmap(in, in_length);
+    }
+    if (out != MAP_FAILED) {
+        munmap(out, out_mapped);
+    }
+    if (!result && out_length < out_mapped && ftruncate(out_fd, out_length)) {
+        error = errno;
+        result = -1;
+    }
+    if (in_fd >= 0) {
+        close(in_fd);
+    }
+    if (out_fd >= 0 && close(out_fd) && !result) {
+        error = errno;
+        result = -1;
+    }
+    if (result) {
+        errno = error;
+    }
+    return result;
+}
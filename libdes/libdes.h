@@ -0,0 +1,192 @@
+/*
+ * libdes: the DES engines from this repository as a library.
+ *
+ * Blocks and keys are uint64_t, with the first bit of DES (bit 1 in the
+ * standard) as the most significant bit.  That is the same as the hex
+ * strings des.py and the other programs take: 0x0123456789abcdefULL is the
+ * block "0123456789abcdef".  Byte buffers hold blocks big endian, 8 bytes
+ * each.
+ *
+ * Keys are 64 bits with the parity bits (the least significant bit of each
+ * byte) ignored, except where noted as 56 bit keys, which have the parity
+ * bits taken out like check_keys prints them.
+ *
+ * Every function is thread safe as long as separate threads don't write the
+ * same buffers.  The ABI is versioned with LIBDES_VERSION; it only changes
+ * with the major version of the shared library.
+ *
+ */
+
+#ifndef LIBDES_H
+#define LIBDES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBDES_VERSION 1
+
+/*
+ * An expanded key.  Treat it as opaque and only fill it in with
+ * libdes_set_key.  It holds every key bit spread across a whole word, which
+ * is what the bitsliced rounds take, so it can be reused for any number of
+ * blocks.
+ */
+struct libdes_key {
+    uint64_t key_bits[64];
+};
+
+// Called by libdes_search for every matching key (56 bits)
+typedef void (*libdes_found_key_fn)(uint64_t key, void* arg);
+
+// Returns LIBDES_VERSION of the library actually linked
+int libdes_version(void);
+
+void libdes_set_key(struct libdes_key* key, uint64_t des_key);
+
+// 56 bit keys to and from 64 bit keys.  The parity bits come back as 0.
+uint64_t libdes_key_from_56(uint64_t key56);
+uint64_t libdes_key_to_56(uint64_t des_key);
+
+/***** Single blocks *****/
+
+uint64_t libdes_encrypt_block(const struct libdes_key* key, uint64_t block);
+uint64_t libdes_decrypt_block(const struct libdes_key* key, uint64_t block);
+
+/***** Bulk (ECB), 64 blocks per pass *****/
+
+// length is in bytes and must be a multiple of 8.  in and out may be the
+// same buffer.  Returns -1 if length isn't a multiple of 8, otherwise 0.
+int libdes_ecb_encrypt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length);
+int libdes_ecb_decrypt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length);
+
+/*
+ * The same, split across num_threads threads, each doing a range of whole 64
+ * block tiles.  num_threads of 0 or less means one per online CPU.  Small
+ * buffers use fewer threads, since starting them would cost more than it
+ * saves.
+ */
+int libdes_ecb_encrypt_mt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length, int num_threads);
+int libdes_ecb_decrypt_mt(const struct libdes_key* key, const unsigned char* in, unsigned char* out, size_t length, int num_threads);
+
+/***** CBC *****/
+
+/*
+ * Same rules as ECB.  Each block of CBC encryption depends on the one
+ * before, so libdes_cbc_encrypt does one block per pass and is about 64
+ * times slower than ECB.  Decryption doesn't, so it's as fast as ECB and
+ * can be split across threads.
+ */
+int libdes_cbc_encrypt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length);
+int libdes_cbc_decrypt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length);
+int libdes_cbc_decrypt_mt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length, int num_threads);
+
+/***** Keystream modes *****/
+
+/*
+ * CTR: block i of the buffer is XORed with the encryption of counter + i
+ * (mod 2^64, big endian like every block).  Encryption and decryption are
+ * the same.  length can be anything; a partial last block uses the start of
+ * its keystream block.  The counters are built already zipped, so only the
+ * keystream is transposed, and it's as fast as ECB.  in and out may be the
+ * same.  libdes_ctr_crypt_mt returns -1 if it can't allocate memory for the
+ * threads, otherwise 0.
+ */
+void libdes_ctr_crypt(const struct libdes_key* key, uint64_t counter, const unsigned char* in, unsigned char* out, size_t length);
+int libdes_ctr_crypt_mt(const struct libdes_key* key, uint64_t counter, const unsigned char* in, unsigned char* out, size_t length, int num_threads);
+
+// The CTR keystream by itself, as if in were all zeros
+void libdes_ctr_keystream(const struct libdes_key* key, uint64_t counter, unsigned char* out, size_t length);
+
+// OFB, with any length.  Like CBC encryption, it's one block per pass.
+void libdes_ofb_crypt(const struct libdes_key* key, uint64_t iv, const unsigned char* in, unsigned char* out, size_t length);
+
+/*
+ * A reproducible random stream for test data, not for secrets: the CTR
+ * keystream under a key taken from the seed.  Treat the struct as opaque.
+ * Values are made 64 at a time.
+ */
+struct libdes_prng {
+    struct libdes_key key;
+    uint64_t counter;
+    uint64_t buffer[64];
+    int available;
+};
+
+void libdes_prng_seed(struct libdes_prng* prng, uint64_t seed);
+uint64_t libdes_prng_next(struct libdes_prng* prng);
+
+// Fills out with the next length bytes of the stream, 8 per value, so a
+// partial last value is thrown away
+void libdes_prng_fill(struct libdes_prng* prng, unsigned char* out, size_t length);
+
+/***** Files *****/
+
+// Flags for libdes_crypt_file
+#define LIBDES_DECRYPT 1
+#define LIBDES_CBC 2
+#define LIBDES_PAD 4  // Add (encrypting) or remove (decrypting) PKCS#5 padding
+#define LIBDES_CTR 8  // CTR mode, with iv as the first counter.  Any length, never padded.
+
+/*
+ * Encrypts or decrypts the file at in_path into out_path, which is created
+ * or truncated.  Both files are memory mapped, so blocks go straight from
+ * the page cache of one to the other, and ECB, CBC decryption or CTR is
+ * split across num_threads threads like the _mt calls.
+ *
+ * Except for CTR, without LIBDES_PAD the input must be a multiple of 8
+ * bytes.  Returns 0, or -1 with errno set.  errno is EINVAL if the length
+ * or padding is wrong, or both LIBDES_CBC and LIBDES_CTR are given.
+ */
+int libdes_crypt_file(const struct libdes_key* key, const char* in_path, const char* out_path, int flags, uint64_t iv, int num_threads);
+
+/***** Many keys *****/
+
+/*
+ * Encrypts or decrypts blocks[i] with keys[i] (64 bit keys) into out[i],
+ * for every i below count, like a database where every record has its own
+ * key.  64 keys and 64 blocks are zipped per pass through the rounds, so a
+ * batch costs what ECB of the same length does plus zipping the keys.  out
+ * may be blocks.  Large batches are split across num_threads threads, or
+ * one per online CPU if num_threads is 0 or less.  Returns -1 if it can't
+ * allocate memory for the threads, otherwise 0.
+ */
+int libdes_encrypt_many(const uint64_t* keys, const uint64_t* blocks, uint64_t* out, size_t count, int num_threads);
+int libdes_decrypt_many(const uint64_t* keys, const uint64_t* blocks, uint64_t* out, size_t count, int num_threads);
+
+/***** Zipped batches *****/
+
+/*
+ * Transposes 64 words, putting bit i of input[j] into bit j of output[i],
+ * counting bits from the most significant.  It is its own inverse.
+ * Zipped blocks and keys are 64 blocks or keys transposed like this, so
+ * word i holds bit i of all of them.
+ */
+void libdes_zip(const uint64_t input[64], uint64_t output[64]);
+
+// Encrypts or decrypts 64 zipped blocks in place, each with its own key from
+// keys_zipped (64 bit keys, zipped).
+void libdes_encrypt_zipped(uint64_t blocks_zipped[64], const uint64_t keys_zipped[64]);
+void libdes_decrypt_zipped(uint64_t blocks_zipped[64], const uint64_t keys_zipped[64]);
+
+/***** Key search *****/
+
+/*
+ * Checks the 2^num_bits 56 bit keys starting at first_key against a
+ * plaintext-ciphertext pair, calling found_key for each one that matches.
+ * The low num_bits bits of first_key must be 0.  This is the check_keys
+ * kernel (crack/check_keys.h), so it is the fastest way to test many keys.
+ *
+ * Returns -1 if num_bits isn't between 6 and 56 or first_key is not
+ * aligned, otherwise 0.
+ */
+int libdes_search(uint64_t plaintext, uint64_t ciphertext, uint64_t first_key, int num_bits, libdes_found_key_fn found_key, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
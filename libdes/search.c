@@ -0,0 +1,44 @@
+/*
+ * Key search for libdes, using the check_keys kernel in crack/check_keys.h.
+ *
+ * The kernel takes its plaintext and ciphertext preprocessed the way
+ * crack/set_input.py writes them into input.h, so that's done here instead,
+ * with set_pair.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "check_keys.h"  // check_key_chunk, set_key_prefix, set_pair
+#include "libdes.h"
+
+int libdes_search(uint64_t plaintext, uint64_t ciphertext, uint64_t first_key, int num_bits, libdes_found_key_fn found_key, void* arg) {
+    uint64_t plaintext_zipped[64];
+    uint64_t ciphertext_zipped[64];
+    bs_t keys_zipped[56];
+    char prefix[57];
+
+    if (num_bits < BS_WIDTH_BITS || num_bits > 56 || first_key >> 56 ||
+            (num_bits < 56 && first_key & ((1ULL << num_bits) - 1))) {
+        return -1;
+    }
+
+    set_pair(plaintext, ciphertext, plaintext_zipped, ciphertext_zipped);
+    const struct key_search search = {
+        .plaintext_zipped = plaintext_zipped,
+        .ciphertext_zipped = ciphertext_zipped,
+        .num_chunk_bits = num_bits,
+        .found_key = found_key,
+        .found_key_arg = arg
+    };
+
+    for (int i=0; i<56-num_bits; i++) {
+        prefix[i] = '0' + ((first_key >> (55-i)) & 1);
+    }
+    prefix[56-num_bits] = '\0';
+    set_key_prefix(keys_zipped, prefix, num_bits);
+
+    check_key_chunk(&search, keys_zipped);
+    return 0;
+}
@@ -0,0 +1,485 @@
+/*
+ * Meet-in-the-middle key search for double DES.
+ *
+ * Double DES encrypts twice: c = E_k2(E_k1(p)).  Instead of trying every
+ * pair of keys, note that the middle value m = E_k1(p) = D_k2(c) can be
+ * computed from either side.  So:
+ *
+ *   1. Encrypt p under every k1 and store (m, k1).
+ *   2. Decrypt c under every k2 and store (m, k2).
+ *   3. Join the two on m.  Every match is a candidate (k1, k2), which is
+ *      checked against a second plaintext-ciphertext pair.
+ *
+ * That is 2^57 DES operations instead of 2^112, traded for a lot of disk.
+ *
+ * Both tables are hash partitioned by the top bits of m into files on disk,
+ * so the join only needs one partition of each side in memory at a time.
+ * Entries are 128 bits: all of m, then the part of the key that isn't fixed
+ * by the key prefix.  Partitions are radix sorted on m, then merge joined on
+ * all 64 bits of it, so the only false candidates are keys that really do
+ * meet in the middle for the first pair.  Fitting an entry in 64 bits would
+ * leave too few bits of m to compare: at 56 key bits, only about 20.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "des_64.h"  // des_encrypt, des_decrypt, zip_64_bit, set_constant_slices
+#include "parse.h"  // parse_number
+
+#define FORWARD 0
+#define BACKWARD 1
+
+// Entries buffered per thread per partition before writing
+#define BUFFER_ENTRIES 2048
+
+struct entry {
+    uint64_t middle;
+    uint64_t key;  // Bits not fixed by the key prefix
+};
+
+struct search {
+    uint64_t plaintexts[2];
+    uint64_t ciphertexts[2];
+    uint64_t key_prefixes[2];  // For k1 and k2
+    int key_bits[2];  // Bits of k1 and k2 not fixed by the prefix
+    int partition_bits;
+    const char* directory;
+    int num_threads;
+
+    FILE** files[2];  // Partition files for each side
+    pthread_mutex_t* file_locks[2];
+
+    uint64_t next_partition;  // Join progress
+    uint64_t num_candidates;
+    uint64_t num_found;
+    pthread_mutex_t lock;
+};
+
+struct thread_args {
+    struct search* search;
+    int side;
+    int thread_num;
+};
+
+
+/***** Helpers *****/
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// 56 zipped key slices to 64, with (unused) parity bits
+static void insert_parity_slices(const uint64_t keys_zipped[56], uint64_t key_bits[64]) {
+    memset(key_bits, 0, 64*8);
+    for (int i=0; i<56; i++) {
+        key_bits[i + i/7] = keys_zipped[i];
+    }
+}
+
+static void partition_filename(const struct search* search, int side, uint64_t partition, char* filename, size_t size) {
+    snprintf(filename, size, "%s/mitm_%s_%05lx", search->directory,
+             side == FORWARD ? "fwd" : "bwd", partition);
+}
+
+
+/***** Phases 1 and 2: Build Tables *****/
+
+static void flush_buffer(struct search* search, int side, uint64_t partition, const struct entry* buffer, int count) {
+    pthread_mutex_lock(&search->file_locks[side][partition]);
+    if (fwrite(buffer, sizeof(struct entry), count, search->files[side][partition]) != (size_t) count) {
+        fprintf(stderr, "Could not write partition file.  Out of disk space?\n");
+        exit(1);
+    }
+    pthread_mutex_unlock(&search->file_locks[side][partition]);
+}
+
+/*
+ * Encrypts the plaintext (forward) or decrypts the ciphertext (backward)
+ * under every key, 64 keys at a time, and appends the middle values to the
+ * partition files.
+ */
+static void* build_thread(void* arg) {
+    struct thread_args* args = arg;
+    struct search* search = args->search;
+    int side = args->side;
+    int key_bits = search->key_bits[side];
+    int partition_bits = search->partition_bits;
+    uint64_t num_partitions = 1ULL << partition_bits;
+
+    struct entry* buffers = malloc(num_partitions * BUFFER_ENTRIES * sizeof(struct entry));
+    int* counts = calloc(num_partitions, sizeof(int));
+    if (!buffers || !counts) {
+        fprintf(stderr, "Not enough memory for partition buffers\n");
+        exit(1);
+    }
+
+    uint64_t input_zipped[64], block[64], middles[64];
+    uint64_t keys_zipped[56], key_bits_zipped[64];
+    set_constant_slices(input_zipped, 64, side == FORWARD ? search->plaintexts[0] : search->ciphertexts[0]);
+
+    // The low 6 bits of the key differ by lane, the rest are constant
+    keys_zipped[50] = 0x00000000ffffffffLL;
+    keys_zipped[51] = 0x0000ffff0000ffffLL;
+    keys_zipped[52] = 0x00ff00ff00ff00ffLL;
+    keys_zipped[53] = 0x0f0f0f0f0f0f0f0fLL;
+    keys_zipped[54] = 0x3333333333333333LL;
+    keys_zipped[55] = 0x5555555555555555LL;
+
+    uint64_t num_batches = 1ULL << (key_bits - 6);
+    for (uint64_t batch=args->thread_num; batch<num_batches; batch+=search->num_threads) {
+
+        uint64_t key = search->key_prefixes[side] << key_bits | batch << 6;
+        set_constant_slices(keys_zipped, 50, key >> 6);
+        insert_parity_slices(keys_zipped, key_bits_zipped);
+
+        memcpy(block, input_zipped, 64*8);
+        if (side == FORWARD) {
+            des_encrypt(block, key_bits_zipped);
+        } else {
+            des_decrypt(block, key_bits_zipped);
+        }
+        zip_64_bit(block, middles);
+
+        for (int lane=0; lane<64; lane++) {
+            uint64_t middle = middles[lane];
+            uint64_t partition = partition_bits ? middle >> (64 - partition_bits) : 0;
+            struct entry* entry = &buffers[partition*BUFFER_ENTRIES + counts[partition]++];
+            entry->middle = middle;
+            entry->key = batch << 6 | lane;
+            if (counts[partition] == BUFFER_ENTRIES) {
+                flush_buffer(search, side, partition, &buffers[partition*BUFFER_ENTRIES], BUFFER_ENTRIES);
+                counts[partition] = 0;
+            }
+        }
+
+    }
+
+    for (uint64_t partition=0; partition<num_partitions; partition++) {
+        flush_buffer(search, side, partition, &buffers[partition*BUFFER_ENTRIES], counts[partition]);
+    }
+    free(buffers);
+    free(counts);
+    return NULL;
+}
+
+static void run_threads(struct search* search, int side, void* (*function)(void*)) {
+    pthread_t* threads = malloc(search->num_threads * sizeof(pthread_t));
+    struct thread_args* args = malloc(search->num_threads * sizeof(struct thread_args));
+    for (int i=0; i<search->num_threads; i++) {
+        args[i].search = search;
+        args[i].side = side;
+        args[i].thread_num = i;
+        pthread_create(&threads[i], NULL, function, &args[i]);
+    }
+    for (int i=0; i<search->num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(args);
+}
+
+static int build_table(struct search* search, int side) {
+    uint64_t num_partitions = 1ULL << search->partition_bits;
+    char filename[4096];
+
+    search->files[side] = malloc(num_partitions * sizeof(FILE*));
+    search->file_locks[side] = malloc(num_partitions * sizeof(pthread_mutex_t));
+    for (uint64_t i=0; i<num_partitions; i++) {
+        partition_filename(search, side, i, filename, sizeof(filename));
+        search->files[side][i] = fopen(filename, "wb");
+        if (!search->files[side][i]) {
+            fprintf(stderr, "Could not open \"%s\"\n", filename);
+            return -1;
+        }
+        pthread_mutex_init(&search->file_locks[side][i], NULL);
+    }
+
+    double start = now();
+    run_threads(search, side, build_thread);
+
+    for (uint64_t i=0; i<num_partitions; i++) {
+        if (fclose(search->files[side][i])) {
+            fprintf(stderr, "Could not write partition file.  Out of disk space?\n");
+            return -1;
+        }
+        pthread_mutex_destroy(&search->file_locks[side][i]);
+    }
+    free(search->files[side]);
+    free(search->file_locks[side]);
+
+    double seconds = now() - start;
+    double keys = (double) (1ULL << search->key_bits[side]);
+    fprintf(stderr, "%s: %.0f keys in %.1f seconds (%.0f keys/second, %.0f MB/second written)\n",
+            side == FORWARD ? "Encrypted" : "Decrypted", keys, seconds,
+            keys / seconds, keys * sizeof(struct entry) / seconds / 1e6);
+    return 0;
+}
+
+
+/***** Phase 3: Join *****/
+
+/*
+ * LSD radix sort on bits [0, high_bit) of the middle value, one byte at a
+ * time.  Bits above high_bit are the same for the whole partition.
+ */
+static void radix_sort(struct entry* entries, struct entry* scratch, uint64_t n, int high_bit) {
+    for (int shift=0; shift<high_bit; shift+=8) {
+        uint64_t counts[256] = {0};
+        for (uint64_t i=0; i<n; i++) {
+            counts[(entries[i].middle >> shift) & 0xff]++;
+        }
+        uint64_t total = 0;
+        for (int digit=0; digit<256; digit++) {
+            uint64_t count = counts[digit];
+            counts[digit] = total;
+            total += count;
+        }
+        for (uint64_t i=0; i<n; i++) {
+            scratch[counts[(entries[i].middle >> shift) & 0xff]++] = entries[i];
+        }
+        struct entry* temp = entries;
+        entries = scratch;
+        scratch = temp;
+    }
+
+    // An odd number of passes leaves the result in scratch
+    if ((high_bit + 7) / 8 % 2) {
+        memcpy(scratch, entries, n * sizeof(struct entry));
+    }
+}
+
+static struct entry* read_partition(const struct search* search, int side, uint64_t partition, uint64_t* n) {
+    char filename[4096];
+    partition_filename(search, side, partition, filename, sizeof(filename));
+
+    FILE* f = fopen(filename, "rb");
+    if (!f || fseek(f, 0, SEEK_END)) {
+        fprintf(stderr, "Could not open \"%s\"\n", filename);
+        exit(1);
+    }
+    *n = ftell(f) / sizeof(struct entry);
+    rewind(f);
+
+    struct entry* entries = malloc((*n + 1) * sizeof(struct entry));
+    if (!entries) {
+        fprintf(stderr, "Not enough memory for a partition.  Use more partitions.\n");
+        exit(1);
+    }
+    if (fread(entries, sizeof(struct entry), *n, f) != *n) {
+        fprintf(stderr, "Could not read \"%s\"\n", filename);
+        exit(1);
+    }
+    fclose(f);
+    unlink(filename);
+    return entries;
+}
+
+/*
+ * Checks up to 64 candidate key pairs against both plaintext-ciphertext
+ * pairs.  With many key bits searched, most keys that meet in the middle
+ * for the first pair are false.
+ */
+static void check_candidates(struct search* search, const uint64_t k1s[64], const uint64_t k2s[64], int n) {
+    uint64_t keys[2][64] = {{0}};
+    uint64_t key_bits_zipped[2][64];
+    uint64_t keys_zipped[64];
+
+    for (int side=0; side<2; side++) {
+        for (int i=0; i<n; i++) {
+            keys[side][i] = (side == FORWARD ? k1s[i] : k2s[i]) << 8;
+        }
+        zip_64_bit(keys[side], keys_zipped);
+        insert_parity_slices(keys_zipped, key_bits_zipped[side]);
+    }
+
+    uint64_t mismatch = n == 64 ? 0 : 0xffffffffffffffffLL >> n;
+    for (int pair=0; pair<2; pair++) {
+        uint64_t block[64], ciphertext_zipped[64];
+        set_constant_slices(block, 64, search->plaintexts[pair]);
+        set_constant_slices(ciphertext_zipped, 64, search->ciphertexts[pair]);
+        des_encrypt(block, key_bits_zipped[FORWARD]);
+        des_encrypt(block, key_bits_zipped[BACKWARD]);
+        for (int i=0; i<64; i++) {
+            mismatch |= block[i] ^ ciphertext_zipped[i];
+        }
+    }
+
+    pthread_mutex_lock(&search->lock);
+    search->num_candidates += n;
+    for (int i=0; i<n; i++) {
+        if (~mismatch & (0x8000000000000000LL >> i)) {
+            printf("0x%014lx 0x%014lx\n", k1s[i], k2s[i]);
+            fflush(stdout);
+            search->num_found++;
+        }
+    }
+    pthread_mutex_unlock(&search->lock);
+}
+
+static void* join_thread(void* arg) {
+    struct thread_args* args = arg;
+    struct search* search = args->search;
+    uint64_t num_partitions = 1ULL << search->partition_bits;
+    int k1_bits = search->key_bits[FORWARD];
+    int k2_bits = search->key_bits[BACKWARD];
+
+    // Bits of the middle value not implied by the partition
+    int high_bit = 64 - search->partition_bits;
+
+    uint64_t k1s[64], k2s[64];
+    int num_candidates = 0;
+
+    while (1) {
+
+        pthread_mutex_lock(&search->lock);
+        uint64_t partition = search->next_partition++;
+        pthread_mutex_unlock(&search->lock);
+        if (partition >= num_partitions) {
+            break;
+        }
+
+        uint64_t n1, n2;
+        struct entry* forward = read_partition(search, FORWARD, partition, &n1);
+        struct entry* backward = read_partition(search, BACKWARD, partition, &n2);
+        struct entry* scratch = malloc(((n1 > n2 ? n1 : n2) + 1) * sizeof(struct entry));
+        if (!scratch) {
+            fprintf(stderr, "Not enough memory for a partition.  Use more partitions.\n");
+            exit(1);
+        }
+        radix_sort(forward, scratch, n1, high_bit);
+        radix_sort(backward, scratch, n2, high_bit);
+        free(scratch);
+
+        // Merge join.  Equal runs on both sides join as a cross product.
+        uint64_t i = 0, j = 0;
+        while (i < n1 && j < n2) {
+            uint64_t middle1 = forward[i].middle;
+            uint64_t middle2 = backward[j].middle;
+            if (middle1 < middle2) {
+                i++;
+            } else if (middle1 > middle2) {
+                j++;
+            } else {
+                uint64_t j_start = j;
+                for (; i < n1 && forward[i].middle == middle1; i++) {
+                    for (j=j_start; j < n2 && backward[j].middle == middle1; j++) {
+                        k1s[num_candidates] = search->key_prefixes[FORWARD] << k1_bits | forward[i].key;
+                        k2s[num_candidates] = search->key_prefixes[BACKWARD] << k2_bits | backward[j].key;
+                        if (++num_candidates == 64) {
+                            check_candidates(search, k1s, k2s, num_candidates);
+                            num_candidates = 0;
+                        }
+                    }
+                }
+            }
+        }
+
+        free(forward);
+        free(backward);
+    }
+
+    if (num_candidates) {
+        check_candidates(search, k1s, k2s, num_candidates);
+    }
+    return NULL;
+}
+
+static void join_tables(struct search* search) {
+    double start = now();
+    run_threads(search, FORWARD, join_thread);
+    double seconds = now() - start;
+    double entries = (double) (1ULL << search->key_bits[FORWARD]) + (double) (1ULL << search->key_bits[BACKWARD]);
+    fprintf(stderr, "Joined: %.0f entries in %.1f seconds (%.0f entries/second, %.0f MB/second read)\n",
+            entries, seconds, entries / seconds, entries * sizeof(struct entry) / seconds / 1e6);
+    fprintf(stderr, "%lu candidates checked, %lu found\n", search->num_candidates, search->num_found);
+}
+
+
+/***** Main *****/
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: mitm [options] <plaintext1> <ciphertext1> <plaintext2> <ciphertext2> [<k1_prefix> [<k2_prefix>]]\n"
+        "\n"
+        "Finds k1 and k2 such that ciphertext = E_k2(E_k1(plaintext)) for both\n"
+        "pairs.  Plaintexts and ciphertexts are 16 hex digits.  Key prefixes are\n"
+        "binary strings, like the ones workers are given, and limit the search to\n"
+        "keys starting with them.  Keys found are printed in hex without parity\n"
+        "bits, k1 then k2.\n"
+        "\n"
+        "Options:\n"
+        "  -t THREADS     Number of threads.  Default is the number of cores.\n"
+        "  -p BITS        Split each table into 2^BITS partition files.  Default 8.\n"
+        "  -d DIRECTORY   Where to put partition files.  Default is \".\".\n");
+    exit(2);
+}
+
+static int parse_prefix(const char* prefix, uint64_t* value, int* key_bits) {
+    int length = strlen(prefix);
+    if (length > 50 || strspn(prefix, "01") != (size_t) length) {
+        return -1;
+    }
+    *value = length ? parse_number(prefix, 2) : 0;
+    *key_bits = 56 - length;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    struct search search;
+    memset(&search, 0, sizeof(search));
+    search.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    search.partition_bits = 8;
+    search.directory = ".";
+    pthread_mutex_init(&search.lock, NULL);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:d:h")) != -1) {
+        switch (opt) {
+            case 't':
+                search.num_threads = parse_number(optarg, 10);
+                break;
+            case 'p':
+                search.partition_bits = parse_number(optarg, 10);
+                break;
+            case 'd':
+                search.directory = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    argv += optind;
+    argc -= optind;
+    if (argc < 4 || argc > 6 || search.num_threads < 1 || search.partition_bits > 12) {
+        usage();
+    }
+
+    for (int pair=0; pair<2; pair++) {
+        search.plaintexts[pair] = parse_number(argv[pair*2], 16);
+        search.ciphertexts[pair] = parse_number(argv[pair*2 + 1], 16);
+    }
+    for (int side=0; side<2; side++) {
+        if (parse_prefix(argc > 4+side ? argv[4+side] : "", &search.key_prefixes[side], &search.key_bits[side])) {
+            fprintf(stderr, "Key prefixes must be binary strings of at most 50 digits\n");
+            return 2;
+        }
+    }
+
+    if (build_table(&search, FORWARD) || build_table(&search, BACKWARD)) {
+        return 1;
+    }
+    join_tables(&search);
+
+    return search.num_found ? 0 : 1;
+}
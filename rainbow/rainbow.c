@@ -0,0 +1,525 @@
+/*
+ * Rainbow tables for DES with a fixed, known plaintext.
+ *
+ * A rainbow table is a time-memory trade-off.  Chains of keys are generated
+ * ahead of time: starting from a key, the plaintext is encrypted, and the
+ * ciphertext is reduced back into a key with a reduction function that is
+ * different for every column of the chain.  Only the first and last key of
+ * each chain are stored.  To find the key for a ciphertext, assume it was in
+ * each column of the chain in turn, walk the chain to the end, and look for
+ * that end in the table.  A match gives a chain start to regenerate from.
+ *
+ * Everything is done 64 chains at a time using the bitsliced encryption in
+ * des_64.h.  The reduction function takes the top 56 bits of the ciphertext
+ * and xors in the column number, which in zipped format is only flipping
+ * slices, so chains never leave zipped format until they end.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "des_64.h"  // des_encrypt, zip_64_bit, set_constant_slices
+#include "parse.h"  // parse_number
+
+#define KEY_MASK 0x00ffffffffffffffLL
+
+static const char MAGIC[8] = "DESRAIN1";
+
+/*
+ * The file starts with this header, followed by num_chains struct chains
+ * sorted by end.  All integers are in host byte order.
+ */
+struct table_header {
+    char magic[8];
+    uint64_t plaintext;
+    uint64_t chain_length;
+    uint64_t num_chains;
+    uint64_t table_index;
+};
+
+// Keys are 56 bits, with the parity bits taken out
+struct chain {
+    uint64_t end;
+    uint64_t start;
+};
+
+struct table {
+    struct table_header header;
+    const struct chain* chains;
+    void* mapping;
+    size_t mapping_size;
+};
+
+
+/***** Chains *****/
+
+/*
+ * Reduction for column t of a table.  Tables with different indexes use
+ * different reduction functions, so their chains don't merge.
+ */
+static uint64_t reduction(uint64_t t, uint64_t table_index) {
+    return (t | table_index << 32) & KEY_MASK;
+}
+
+static uint64_t reduce(uint64_t ciphertext, uint64_t t, uint64_t table_index) {
+    return (ciphertext >> 8) ^ reduction(t, table_index);
+}
+
+// Sets each of the n slices to all 0s or all 1s, according to value's bits
+// Convert between 64 56-bit keys and 56 zipped slices
+static void zip_keys(const uint64_t keys[64], uint64_t keys_zipped[56]) {
+    uint64_t shifted[64], zipped[64];
+    for (int i=0; i<64; i++) {
+        shifted[i] = keys[i] << 8;
+    }
+    zip_64_bit(shifted, zipped);
+    memcpy(keys_zipped, zipped, 56*8);
+}
+
+static void unzip_keys(const uint64_t keys_zipped[56], uint64_t keys[64]) {
+    uint64_t padded[64] = {0};
+    memcpy(padded, keys_zipped, 56*8);
+    zip_64_bit(padded, keys);
+    for (int i=0; i<64; i++) {
+        keys[i] >>= 8;
+    }
+}
+
+/*
+ * Advances the chains in the lanes set in active by one column:
+ * key = reduce(E_key(plaintext), t).
+ */
+static void chain_step(uint64_t keys_zipped[56], const uint64_t plaintext_zipped[64],
+                       uint64_t t, uint64_t table_index, uint64_t active) {
+    uint64_t block[64];
+    uint64_t key_bits[64] = {0};
+    uint64_t flips[56];
+
+    // Insert the (unused) parity bits
+    for (int i=0; i<56; i++) {
+        key_bits[i + i/7] = keys_zipped[i];
+    }
+
+    memcpy(block, plaintext_zipped, 64*8);
+    des_encrypt(block, key_bits);
+
+    set_constant_slices(flips, 56, reduction(t, table_index));
+    for (int i=0; i<56; i++) {
+        keys_zipped[i] = ((block[i] ^ flips[i]) & active) | (keys_zipped[i] & ~active);
+    }
+}
+
+// Lanes 0 to n-1 (from the most significant bit)
+static uint64_t first_lanes(uint64_t n) {
+    return n >= 64 ? 0xffffffffffffffffLL : ~(0xffffffffffffffffLL >> n);
+}
+
+
+/***** Generate *****/
+
+struct generate_args {
+    uint64_t plaintext_zipped[64];
+    uint64_t chain_length;
+    uint64_t num_chains;
+    uint64_t first_start;
+    uint64_t table_index;
+    struct chain* chains;
+    int thread_num;
+    int num_threads;
+};
+
+static void* generate_thread(void* arg) {
+    struct generate_args* args = arg;
+    uint64_t keys[64];
+    uint64_t keys_zipped[56];
+
+    uint64_t num_batches = (args->num_chains + 63) / 64;
+    for (uint64_t batch=args->thread_num; batch<num_batches; batch+=args->num_threads) {
+
+        for (int i=0; i<64; i++) {
+            keys[i] = (args->first_start + batch*64 + i) & KEY_MASK;
+        }
+        zip_keys(keys, keys_zipped);
+
+        for (uint64_t t=0; t<args->chain_length; t++) {
+            chain_step(keys_zipped, args->plaintext_zipped, t, args->table_index, 0xffffffffffffffffLL);
+        }
+
+        uint64_t ends[64];
+        unzip_keys(keys_zipped, ends);
+        for (int i=0; i<64 && batch*64 + i < args->num_chains; i++) {
+            args->chains[batch*64 + i].start = keys[i];
+            args->chains[batch*64 + i].end = ends[i];
+        }
+
+    }
+    return NULL;
+}
+
+static int compare_chains(const void* a, const void* b) {
+    uint64_t end_a = ((const struct chain*) a)->end;
+    uint64_t end_b = ((const struct chain*) b)->end;
+    return (end_a > end_b) - (end_a < end_b);
+}
+
+static int generate(uint64_t plaintext, uint64_t chain_length, uint64_t num_chains,
+                    uint64_t first_start, uint64_t table_index, int num_threads,
+                    const char* filename) {
+
+    struct chain* chains = malloc(num_chains * sizeof(struct chain));
+    struct generate_args* args = malloc(num_threads * sizeof(struct generate_args));
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    if (!chains || !args || !threads) {
+        fprintf(stderr, "Not enough memory for %lu chains\n", num_chains);
+        return 1;
+    }
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    for (int i=0; i<num_threads; i++) {
+        set_constant_slices(args[i].plaintext_zipped, 64, plaintext);
+        args[i].chain_length = chain_length;
+        args[i].num_chains = num_chains;
+        args[i].first_start = first_start;
+        args[i].table_index = table_index;
+        args[i].chains = chains;
+        args[i].thread_num = i;
+        args[i].num_threads = num_threads;
+        pthread_create(&threads[i], NULL, generate_thread, &args[i]);
+    }
+    for (int i=0; i<num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Sort by end and drop chains that merged into another
+    qsort(chains, num_chains, sizeof(struct chain), compare_chains);
+    uint64_t num_unique = 0;
+    for (uint64_t i=0; i<num_chains; i++) {
+        if (num_unique == 0 || chains[i].end != chains[num_unique-1].end) {
+            chains[num_unique++] = chains[i];
+        }
+    }
+
+    struct table_header header;
+    memcpy(header.magic, MAGIC, 8);
+    header.plaintext = plaintext;
+    header.chain_length = chain_length;
+    header.num_chains = num_unique;
+    header.table_index = table_index;
+
+    FILE* f = fopen(filename, "wb");
+    if (!f ||
+            fwrite(&header, sizeof(header), 1, f) != 1 ||
+            fwrite(chains, sizeof(struct chain), num_unique, f) != num_unique ||
+            fclose(f)) {
+        fprintf(stderr, "Could not write \"%s\"\n", filename);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    printf("Generated %lu chains (%lu unique) of length %lu in %.1f seconds\n",
+           num_chains, num_unique, chain_length, seconds);
+    if (seconds > 0) {
+        printf("%.0f encryptions per second\n", num_chains * (double) chain_length / seconds);
+    }
+
+    free(chains);
+    free(args);
+    free(threads);
+    return 0;
+}
+
+
+/***** Lookup *****/
+
+static int open_table(const char* filename, struct table* table) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "Could not open \"%s\"\n", filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    table->mapping_size = st.st_size;
+    table->mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (table->mapping == MAP_FAILED || (size_t) st.st_size < sizeof(struct table_header)) {
+        fprintf(stderr, "Could not map \"%s\"\n", filename);
+        return -1;
+    }
+
+    memcpy(&table->header, table->mapping, sizeof(struct table_header));
+    table->chains = (const struct chain*) ((char*) table->mapping + sizeof(struct table_header));
+    if (memcmp(table->header.magic, MAGIC, 8) ||
+            sizeof(struct table_header) + table->header.num_chains * sizeof(struct chain) != (size_t) st.st_size) {
+        fprintf(stderr, "\"%s\" is not a rainbow table\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+// Returns the start of the chain ending in end, or -1 if there is none
+static int64_t find_chain(const struct table* table, uint64_t end) {
+    uint64_t low = 0, high = table->header.num_chains;
+    while (low < high) {
+        uint64_t mid = low + (high-low)/2;
+        if (table->chains[mid].end < end) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < table->header.num_chains && table->chains[low].end == end) {
+        return table->chains[low].start;
+    }
+    return -1;
+}
+
+struct lookup_state {
+    const struct table* table;
+    uint64_t ciphertext;
+    uint64_t next_column;  // Next batch of columns to check
+    int found;
+    uint64_t found_key;
+    pthread_mutex_t lock;
+};
+
+/*
+ * Regenerates up to 64 chains from their start to the given column and
+ * checks if the key there encrypts to the ciphertext.  Most matches in the
+ * table are false alarms from chains that merged with the ciphertext's.
+ */
+static void check_candidates(struct lookup_state* state, const uint64_t starts[64],
+                             const uint64_t columns[64], int n) {
+    const struct table_header* header = &state->table->header;
+    uint64_t plaintext_zipped[64], ciphertext_zipped[64];
+    uint64_t keys[64] = {0};
+    uint64_t keys_zipped[56];
+
+    set_constant_slices(plaintext_zipped, 64, header->plaintext);
+    set_constant_slices(ciphertext_zipped, 64, state->ciphertext);
+    memcpy(keys, starts, n*8);
+    zip_keys(keys, keys_zipped);
+
+    uint64_t max_column = 0;
+    for (int i=0; i<n; i++) {
+        if (columns[i] > max_column) {
+            max_column = columns[i];
+        }
+    }
+
+    for (uint64_t t=0; t<max_column; t++) {
+        uint64_t active = 0;
+        for (int i=0; i<n; i++) {
+            if (t < columns[i]) {
+                active |= 0x8000000000000000LL >> i;
+            }
+        }
+        chain_step(keys_zipped, plaintext_zipped, t, header->table_index, active);
+    }
+
+    // Encrypt once more and compare with the ciphertext
+    uint64_t block[64];
+    uint64_t key_bits[64] = {0};
+    for (int i=0; i<56; i++) {
+        key_bits[i + i/7] = keys_zipped[i];
+    }
+    memcpy(block, plaintext_zipped, 64*8);
+    des_encrypt(block, key_bits);
+    uint64_t mismatch = ~first_lanes(n);
+    for (int i=0; i<64; i++) {
+        mismatch |= block[i] ^ ciphertext_zipped[i];
+    }
+
+    if (mismatch != 0xffffffffffffffffLL) {
+        unzip_keys(keys_zipped, keys);
+        for (int i=0; i<n; i++) {
+            if (~mismatch & (0x8000000000000000LL >> i)) {
+                pthread_mutex_lock(&state->lock);
+                state->found = 1;
+                state->found_key = keys[i];
+                pthread_mutex_unlock(&state->lock);
+            }
+        }
+    }
+}
+
+static void* lookup_thread(void* arg) {
+    struct lookup_state* state = arg;
+    const struct table_header* header = &state->table->header;
+    uint64_t plaintext_zipped[64];
+    uint64_t keys[64], ends[64];
+    uint64_t keys_zipped[56];
+    uint64_t candidate_starts[64], candidate_columns[64];
+    int num_candidates = 0;
+
+    set_constant_slices(plaintext_zipped, 64, header->plaintext);
+
+    while (1) {
+
+        // Take the next 64 columns
+        pthread_mutex_lock(&state->lock);
+        uint64_t first_column = state->next_column;
+        state->next_column += 64;
+        int found = state->found;
+        pthread_mutex_unlock(&state->lock);
+        if (first_column >= header->chain_length || found) {
+            break;
+        }
+
+        // Lane i assumes the ciphertext is in column first_column+i, so the
+        // next key in its chain is the reduction of the ciphertext.
+        for (int i=0; i<64; i++) {
+            keys[i] = reduce(state->ciphertext, first_column + i, header->table_index);
+        }
+        zip_keys(keys, keys_zipped);
+
+        // Walk every lane to the end of the chain.  Lane i joins in at
+        // column first_column+i+1.
+        for (uint64_t t=first_column+1; t<header->chain_length; t++) {
+            chain_step(keys_zipped, plaintext_zipped, t, header->table_index,
+                       first_lanes(t - first_column));
+        }
+
+        unzip_keys(keys_zipped, ends);
+        for (int i=0; i<64 && first_column + i < header->chain_length; i++) {
+            int64_t start = find_chain(state->table, ends[i]);
+            if (start < 0) {
+                continue;
+            }
+            candidate_starts[num_candidates] = start;
+            candidate_columns[num_candidates] = first_column + i;
+            num_candidates++;
+            if (num_candidates == 64) {
+                check_candidates(state, candidate_starts, candidate_columns, num_candidates);
+                num_candidates = 0;
+            }
+        }
+
+    }
+
+    if (num_candidates) {
+        check_candidates(state, candidate_starts, candidate_columns, num_candidates);
+    }
+    return NULL;
+}
+
+static int lookup(uint64_t ciphertext, int num_tables, char** filenames, int num_threads) {
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+
+    for (int i=0; i<num_tables; i++) {
+
+        struct table table;
+        if (open_table(filenames[i], &table)) {
+            return 1;
+        }
+
+        struct lookup_state state;
+        state.table = &table;
+        state.ciphertext = ciphertext;
+        state.next_column = 0;
+        state.found = 0;
+        pthread_mutex_init(&state.lock, NULL);
+
+        for (int j=0; j<num_threads; j++) {
+            pthread_create(&threads[j], NULL, lookup_thread, &state);
+        }
+        for (int j=0; j<num_threads; j++) {
+            pthread_join(threads[j], NULL);
+        }
+        munmap(table.mapping, table.mapping_size);
+
+        if (state.found) {
+            printf("0x%014lx\n", state.found_key);
+            free(threads);
+            return 0;
+        }
+
+    }
+
+    fprintf(stderr, "Key not found\n");
+    free(threads);
+    return 1;
+}
+
+
+/***** Main *****/
+
+static void usage() {
+    fprintf(stderr,
+        "Usage:\n"
+        "  rainbow generate [options] <plaintext> <chain_length> <num_chains> <table_file>\n"
+        "  rainbow lookup [options] <ciphertext> <table_file>...\n"
+        "\n"
+        "Plaintext and ciphertext are 16 hex digits.  Found keys are printed in hex\n"
+        "without parity bits, like check_keys does.\n"
+        "\n"
+        "Options:\n"
+        "  -t THREADS  Number of threads.  Default is the number of cores.\n"
+        "  -i INDEX    (generate) Table index.  Tables for the same plaintext need\n"
+        "              different indexes to be useful together.  Default 0.\n"
+        "  -s START    (generate) First chain start key.  Default 0.\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+
+    if (argc < 2) {
+        usage();
+    }
+    const char* command = argv[1];
+    argv++;
+    argc--;
+
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t table_index = 0;
+    uint64_t first_start = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:i:s:h")) != -1) {
+        switch (opt) {
+            case 't':
+                num_threads = parse_number(optarg, 10);
+                break;
+            case 'i':
+                table_index = parse_number(optarg, 10);
+                break;
+            case 's':
+                first_start = parse_number(optarg, 0);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (num_threads < 1 || table_index >= 1<<24) {
+        usage();
+    }
+    argv += optind;
+    argc -= optind;
+
+    if (!strcmp(command, "generate") && argc == 4) {
+        uint64_t chain_length = parse_number(argv[1], 10);
+        if (chain_length == 0 || chain_length > 0xffffffffLL) {
+            usage();
+        }
+        return generate(parse_number(argv[0], 16), chain_length, parse_number(argv[2], 10),
+                        first_start, table_index, num_threads, argv[3]);
+    } else if (!strcmp(command, "lookup") && argc >= 2) {
+        return lookup(parse_number(argv[0], 16), argc-1, &argv[1], num_threads);
+    }
+    usage();
+
+}